@@ -0,0 +1,18 @@
+//
+// Host build of the benchmark sweep, printing CSV to stdout
+//
+// usage: bench > bench.csv
+//
+
+#include "engine.h"
+#include "bench_sweep.h"
+
+int main()
+{
+	auto* engine = new SynthEngine();
+	bench_sweep(*engine);
+	delete engine;
+
+	bench_parser();
+	return 0;
+}
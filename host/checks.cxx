@@ -0,0 +1,196 @@
+//
+// Behaviour checks
+//
+// Small targeted checks of engine behaviour that the golden renders
+// don't pin down directly.  Each prints ok or FAIL with a reason.
+//
+// usage: checks
+//
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "engine.h"
+#include "envelope.h"
+#include "midi_queue.h"
+
+static int failures = 0;
+
+static void report(const char* name, bool ok, const char* why)
+{
+	if (ok) {
+		printf("%-24s ok\n", name);
+	} else {
+		printf("%-24s FAIL %s\n", name, why);
+		++failures;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Envelopes
+//--------------------------------------------------------------------+
+
+// a 0 ms attack reaches full level with no ramp, so from the first
+// sample of the block
+static void zero_attack()
+{
+	ADSR env(0, 100, 64, 100);
+	env.gate_on();
+	env.update();
+
+	report("zero_attack", env.level() == 0x7fff && env.ramp() == 0,
+		"0 ms attack doesn't start at full level");
+}
+
+//--------------------------------------------------------------------+
+// Voice allocation
+//--------------------------------------------------------------------+
+
+// with every voice held on one channel, each new note cuts the oldest
+static void steal_oldest()
+{
+	auto* engine = new SynthEngine();
+	engine->midi_in(0x90, 10, 100);
+	engine->midi_in(0x90, 11, 100);
+	for (uint32_t i = 0; i < MAX_VOICES - 1; ++i) {
+		engine->midi_in(0x90, 20 + i % 100, 100);
+	}
+
+	bool first_cut = !engine->playing(0, 10) && engine->playing(0, 11);
+	engine->midi_in(0x90, 12, 100);
+	bool second_cut = !engine->playing(0, 11) && engine->playing(0, 12);
+	delete engine;
+
+	report("steal_oldest", first_cut && second_cut,
+		"a newer note was cut instead of the oldest");
+}
+
+//--------------------------------------------------------------------+
+// MIDI queue
+//--------------------------------------------------------------------+
+
+// more order-sensitive messages than the FIFO holds, with the queue
+// drained only between the producer's turns, as on the device where
+// core 1 waits for core 0 - the producer must hold packets back rather
+// than wait, and all of them must still arrive
+static void paced_producer()
+{
+	static int32_t samples[2 * BUFFER_SIZE];
+	static MidiQueue queue;
+	queue.init();
+	auto* engine = new SynthEngine();
+
+	// 100 notes on, then a panic of note offs for every key
+	std::vector<std::array<uint8_t, 4>> packets;
+	for (uint8_t n = 20; n < 120; ++n) {
+		packets.push_back({ 0x09, 0x90, n, 100 });
+	}
+	for (uint8_t n = 0; n < 128; ++n) {
+		packets.push_back({ 0x08, 0x80, n, 0 });
+	}
+
+	size_t sent = 0, turns = 0;
+	bool all_on = true;
+	while (sent < packets.size() && turns < 100) {
+		// producer's turn - returns as soon as the queue is full
+		while (sent < packets.size() &&
+			   queue.try_push(packets[sent].data()) != MidiQueue::full)
+		{
+			++sent;
+		}
+		++turns;
+
+		// consumer's turn, once the producer has returned
+		queue.drain(*engine);
+		memset(samples, 0, sizeof(samples));
+		engine->update(samples, BUFFER_SIZE);
+
+		// every note on sent so far has a voice
+		for (uint8_t n = 20; n < 120 && n - 20u < sent; ++n) {
+			all_on &= engine->playing(0, n);
+		}
+	}
+
+	// let the releases finish
+	for (uint32_t b = 0; b < 10 * SAMPLE_RATE / BUFFER_SIZE; ++b) {
+		memset(samples, 0, sizeof(samples));
+		engine->update(samples, BUFFER_SIZE);
+	}
+	bool idle = engine->idle();
+	delete engine;
+
+	report("paced_producer", sent == packets.size() && turns > 1 && all_on && idle,
+		sent < packets.size() ? "the producer stalled" :
+		turns == 1 ? "the queue never filled" :
+		!all_on ? "note ons were lost" :
+		"note offs were lost");
+}
+
+//--------------------------------------------------------------------+
+// Idle detection
+//--------------------------------------------------------------------+
+
+// after a note ends, a host sending only MIDI clock and active sensing
+// must neither wake the device (try_push() queueing the packets) nor
+// keep the engine from going idle
+static void clock_only_idle()
+{
+	static int32_t samples[2 * BUFFER_SIZE];
+	static const uint8_t note_on[4] = { 0x09, 0x90, 60, 100 };
+	static const uint8_t note_off[4] = { 0x08, 0x80, 60, 0 };
+	static const uint8_t clock[4] = { 0x0f, 0xf8, 0, 0 };
+	static const uint8_t sensing[4] = { 0x0f, 0xfe, 0, 0 };
+
+	// the queue lives as long as the program, as on the device
+	static MidiQueue queue;
+	queue.init();
+	auto* engine = new SynthEngine();
+
+	bool accepted = queue.try_push(note_on) == MidiQueue::queued;
+	queue.drain(*engine);
+	engine->update(samples, BUFFER_SIZE);
+	bool playing = !engine->idle();
+	accepted &= queue.try_push(note_off) == MidiQueue::queued;
+
+	// about ten seconds, with more clock and active sensing in each
+	// block than a host would send
+	uint32_t wakes = 0, idle_blocks = 0;
+	for (uint32_t b = 0; b < 10 * SAMPLE_RATE / BUFFER_SIZE; ++b) {
+		for (uint8_t i = 0; i < 3; ++i) {
+			wakes += queue.try_push(clock) == MidiQueue::queued;
+		}
+		wakes += queue.try_push(sensing) == MidiQueue::queued;
+
+		queue.drain(*engine);
+		memset(samples, 0, sizeof(samples));
+		engine->update(samples, BUFFER_SIZE);
+		idle_blocks = engine->idle() ? idle_blocks + 1 : 0;
+	}
+
+	delete engine;
+
+	// the release has long finished, so all but the first few seconds
+	// must have been idle
+	bool idle = idle_blocks > 5 * SAMPLE_RATE / BUFFER_SIZE;
+	report("clock_only_idle", accepted && playing && !wakes && idle,
+		!accepted ? "notes weren't accepted" :
+		!playing ? "the note didn't play" :
+		wakes ? "realtime messages were accepted as engine input" :
+		"the engine didn't go idle with only clock traffic");
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+int main()
+{
+	zero_attack();
+	steal_oldest();
+	paced_producer();
+	clock_only_idle();
+
+	return failures ? 1 : 0;
+}
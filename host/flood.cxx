@@ -0,0 +1,57 @@
+//
+// Host build of the MIDI flood stress test, printing CSV to stdout
+//
+// The producer and the engine run in turn on one thread, in simulated
+// time: before each block, the events due by the end of that block
+// are queued, then the queue is drained and the block rendered.  The
+// block render times are real, and are checked against the real-time
+// deadline.
+//
+// usage: flood > flood.csv
+//
+
+#include <cstring>
+
+#include "bench.h"
+#include "engine.h"
+#include "midi_flood.h"
+#include "midi_queue.h"
+
+int main()
+{
+	auto* engine = new SynthEngine();
+	auto* queue = new MidiQueue();
+	auto* flood = new MidiFlood();
+
+	static int32_t samples[2 * BUFFER_SIZE];
+	static int32_t chorus[BUFFER_SIZE];
+	static int32_t reverb[BUFFER_SIZE];
+
+	queue->init();
+	bench_init();
+
+	uint64_t block = 0;
+	flood->begin(*queue, 0);
+
+	while (flood->running()) {
+		uint64_t now = ++block * BUFFER_SIZE * 1000000 / SAMPLE_RATE;
+		flood->produce(*queue, now);
+
+		uint32_t t0 = bench_time();
+
+		queue->drain(*engine);
+		memset(samples, 0, sizeof(samples));
+		memset(chorus, 0, sizeof(chorus));
+		memset(reverb, 0, sizeof(reverb));
+		engine->update(samples, BUFFER_SIZE, chorus, reverb);
+
+		uint32_t t1 = bench_time();
+		flood->block(bench_delta(t0, t1));
+	}
+
+	delete flood;
+	delete queue;
+	delete engine;
+
+	return 0;
+}
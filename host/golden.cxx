@@ -0,0 +1,353 @@
+//
+// Golden render regression suite
+//
+// Plays scripted MIDI sequences through the engine and the effects
+// stage and compares the 16-bit output with stored golden renders.
+// Each scenario has a hash of the whole render, which must match for a
+// bit-exact result, and a copy of the render decimated to every fourth
+// frame.  Otherwise the decimated renders are compared sample by
+// sample, against the scenario's declared SNR and max error.
+//
+// usage: golden <golden dir> [--update]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "engine.h"
+#include "effects.h"
+#include "midi.h"
+
+//--------------------------------------------------------------------+
+// Scripted MIDI
+//--------------------------------------------------------------------+
+
+struct Event {
+	uint32_t	block;
+	uint8_t		status;
+	uint8_t		d1;
+	uint8_t		d2;
+	uint8_t		port;
+};
+
+typedef std::vector<Event> Script;
+
+struct Scenario {
+	const char*	name;
+	uint32_t	blocks;
+	double		min_snr;		// dB, against the golden render
+	int32_t		max_error;		// largest difference in any sample
+	void		(*script)(Script& s);
+};
+
+static void cc(Script& s, uint32_t b, uint8_t chan, uint8_t cc, uint8_t v, uint8_t port = 0)
+{
+	s.push_back({ b, (uint8_t)(0xb0 | chan), cc, v, port });
+}
+
+static void note(Script& s, uint32_t b, uint32_t len, uint8_t chan, uint8_t n, uint8_t vel, uint8_t port = 0)
+{
+	s.push_back({ b, (uint8_t)(0x90 | chan), n, vel, port });
+	s.push_back({ b + len, (uint8_t)(0x80 | chan), n, 0, port });
+}
+
+static void bend(Script& s, uint32_t b, uint8_t chan, uint16_t v, uint8_t port = 0)
+{
+	s.push_back({ b, (uint8_t)(0xe0 | chan), (uint8_t)(v & 0x7f), (uint8_t)(v >> 7), port });
+}
+
+static void program(Script& s, uint32_t b, uint8_t chan, uint8_t p, uint8_t port = 0)
+{
+	s.push_back({ b, (uint8_t)(0xc0 | chan), p, 0, port });
+}
+
+// rapid chords on all four presets
+static void note_storm(Script& s)
+{
+	for (uint8_t c = 0; c < 4; ++c) {
+		program(s, 0, c, c);
+	}
+	for (uint32_t b = 0; b < 200; b += 2) {
+		uint8_t c = (b >> 1) & 3;
+		note(s, b, 5 + (b % 13), c, 36 + (b * 7) % 60, 40 + (b * 3) % 87);
+	}
+}
+
+// pitch bend sweeps at the default and an RPN-set range, with vibrato
+static void bends(Script& s)
+{
+	cc(s, 0, 1, rpn_msb, 0);
+	cc(s, 0, 1, rpn_lsb, 0);
+	cc(s, 0, 1, data_entry_msb, 12);
+	note(s, 1, 250, 0, 60, 100);
+	note(s, 1, 250, 1, 67, 100);
+	for (uint32_t b = 0; b < 240; ++b) {
+		uint16_t v = (b * 273) & 0x3fff;
+		bend(s, b, 0, v);
+		bend(s, b, 1, 16383 - v);
+	}
+	cc(s, 100, 0, modwheel, 127);
+}
+
+// program changes while notes are sounding
+static void program_changes(Script& s)
+{
+	for (uint32_t b = 0; b < 240; b += 20) {
+		program(s, b, 0, b / 20);
+		note(s, b, 30, 0, 48 + b / 10, 110);
+		note(s, b + 5, 30, 0, 55 + b / 10, 90);
+	}
+}
+
+// more held notes than voices, on both ports
+static void voice_stealing(Script& s)
+{
+	for (uint32_t i = 0; i < 160; ++i) {
+		uint8_t port = i & 1;
+		uint8_t chan = (i >> 1) & 3;
+		note(s, i, 200, chan, 24 + i % 80, 100, port);
+	}
+}
+
+// pedals, portamento and mono mode
+static void pedals_glide(Script& s)
+{
+	cc(s, 0, 0, sustain, 127);
+	note(s, 0, 10, 0, 60, 100);
+	note(s, 5, 10, 0, 64, 100);
+	cc(s, 60, 0, sustain, 0);
+
+	note(s, 70, 100, 1, 48, 100);
+	cc(s, 75, 1, sostenuto, 127);
+	note(s, 80, 10, 1, 55, 100);
+	cc(s, 180, 1, sostenuto, 0);
+
+	program(s, 0, 2, 1);
+	cc(s, 0, 2, portamento, 127);
+	cc(s, 0, 2, mono_on, 0);
+	for (uint32_t b = 100; b < 220; b += 15) {
+		note(s, b, 20, 2, 40 + (b % 24), 100);
+	}
+}
+
+// an MPE lower zone with per-note bend, pressure and timbre
+static void mpe(Script& s)
+{
+	cc(s, 0, 0, rpn_msb, 0);
+	cc(s, 0, 0, rpn_lsb, 6);
+	cc(s, 0, 0, data_entry_msb, 7);
+	for (uint8_t i = 0; i < 4; ++i) {
+		note(s, 1 + i * 10, 150, 1 + i, 55 + i * 4, 100);
+	}
+	for (uint32_t b = 0; b < 200; ++b) {
+		for (uint8_t i = 0; i < 4; ++i) {
+			bend(s, b, 1 + i, 8192 + ((i & 1) ? 10 : -10) * b);
+			s.push_back({ b, (uint8_t)(0xd1 + i), (uint8_t)((b * (i + 1)) & 0x7f), 0, 0 });
+			cc(s, b, 1 + i, brightness, (b + i * 32) & 0x7f);
+		}
+	}
+}
+
+// chorus and reverb sends
+static void effects(Script& s)
+{
+	cc(s, 0, 0, chorus_send, 127);
+	cc(s, 0, 1, reverb_send, 127);
+	program(s, 0, 1, 3);
+	note(s, 0, 40, 0, 57, 120);
+	note(s, 20, 10, 1, 64, 120);
+	note(s, 22, 10, 1, 71, 120);
+}
+
+// the tolerances allow for rounding changes in the engine, which cost a
+// few LSBs (50 - 60 dB SNR), but not for a wrong pitch, level or pan,
+// which leave the SNR near 0 dB - the reverb's feedback spreads small
+// errors, so its scenario is looser
+static const Scenario scenarios[] = {
+	{ "note_storm",			300,	40,		64,		note_storm },
+	{ "bends",				300,	40,		64,		bends },
+	{ "program_changes",	300,	40,		64,		program_changes },
+	{ "voice_stealing",		400,	40,		64,		voice_stealing },
+	{ "pedals_glide",		300,	40,		64,		pedals_glide },
+	{ "mpe",				250,	40,		64,		mpe },
+	{ "effects",			400,	35,		128,	effects },
+};
+
+//--------------------------------------------------------------------+
+// Rendering
+//--------------------------------------------------------------------+
+
+// frames kept in the stored copy of a render
+static const size_t decimate = 4;
+
+struct Render {
+	uint64_t				hash = 1469598103934665603ULL;	// FNV-1a
+	std::vector<int16_t>	pcm;							// decimated, stereo
+};
+
+static void render(const Scenario& sc, Render& r)
+{
+	static int32_t samples[2 * BUFFER_SIZE];
+	static int32_t chorus[BUFFER_SIZE];
+	static int32_t reverb[BUFFER_SIZE];
+
+	auto* engine = new SynthEngine();
+	auto* fx = new Effects();
+
+	Script s;
+	sc.script(s);
+
+	for (uint32_t b = 0; b < sc.blocks; ++b) {
+		for (auto& e : s) {
+			if (e.block == b) {
+				engine->midi_in(e.status, e.d1, e.d2, e.port);
+			}
+		}
+
+		memset(samples, 0, sizeof(samples));
+		memset(chorus, 0, sizeof(chorus));
+		memset(reverb, 0, sizeof(reverb));
+		engine->update(samples, BUFFER_SIZE, chorus, reverb);
+		fx->process(samples, chorus, reverb, BUFFER_SIZE);
+
+		// as output to I2S
+		for (size_t i = 0; i < 2 * BUFFER_SIZE; ++i) {
+			int16_t out = clamp16(samples[i] >> 6);
+			for (uint8_t j = 0; j < 2; ++j) {
+				r.hash ^= (uint8_t)(out >> (8 * j));
+				r.hash *= 1099511628211ULL;
+			}
+			if ((i >> 1) % decimate == 0) {
+				r.pcm.push_back(out);
+			}
+		}
+	}
+
+	delete fx;
+	delete engine;
+}
+
+//--------------------------------------------------------------------+
+// Golden files
+//--------------------------------------------------------------------+
+
+// each scenario has <name>.txt with the hash, and <name>.pcm with the
+// decimated render as 16-bit little-endian stereo
+static bool load(const std::string& path, Render& r)
+{
+	std::ifstream in(path + ".txt");
+	if (!in) return false;
+
+	std::string hex;
+	in >> hex;
+	r.hash = strtoull(hex.c_str(), nullptr, 16);
+
+	std::ifstream pcm(path + ".pcm", std::ios::binary);
+	if (!pcm) return false;
+
+	uint8_t b[2];
+	while (pcm.read((char*)b, 2)) {
+		r.pcm.push_back((int16_t)(b[0] | (b[1] << 8)));
+	}
+	return true;
+}
+
+static bool save(const std::string& path, const Render& r)
+{
+	FILE* f = fopen((path + ".txt").c_str(), "w");
+	if (!f) return false;
+	fprintf(f, "%016llx\n", (unsigned long long)r.hash);
+	fclose(f);
+
+	f = fopen((path + ".pcm").c_str(), "wb");
+	if (!f) return false;
+	for (auto v : r.pcm) {
+		fputc(v & 0xff, f);
+		fputc((v >> 8) & 0xff, f);
+	}
+	fclose(f);
+	return true;
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <golden dir> [--update]\n", argv[0]);
+		return 2;
+	}
+
+	std::string dir = argv[1];
+	bool update = (argc > 2 && !strcmp(argv[2], "--update"));
+	int failures = 0;
+
+	for (auto& sc : scenarios) {
+		Render r;
+		render(sc, r);
+
+		std::string path = dir + "/" + sc.name;
+
+		if (update) {
+			if (!save(path, r)) {
+				printf("%-16s cannot write %s.*\n", sc.name, path.c_str());
+				++failures;
+			} else {
+				printf("%-16s %016llx updated\n", sc.name, (unsigned long long)r.hash);
+			}
+			continue;
+		}
+
+		Render g;
+		if (!load(path, g)) {
+			printf("%-16s FAIL no golden files %s.*\n", sc.name, path.c_str());
+			++failures;
+			continue;
+		}
+
+		if (r.hash == g.hash) {
+			printf("%-16s ok (bit-exact)\n", sc.name);
+			continue;
+		}
+
+		// not bit-exact, so compare the renders sample by sample
+		if (g.pcm.size() != r.pcm.size()) {
+			printf("%-16s FAIL render is %zu samples, golden is %zu\n",
+				sc.name, r.pcm.size(), g.pcm.size());
+			++failures;
+			continue;
+		}
+
+		double signal = 0, noise = 0;
+		int32_t worst = 0;
+		size_t at = 0;
+		for (size_t i = 0; i < r.pcm.size(); ++i) {
+			int32_t err = std::abs(r.pcm[i] - g.pcm[i]);
+			if (err > worst) {
+				worst = err;
+				at = i;
+			}
+			signal += (double)g.pcm[i] * g.pcm[i];
+			noise += (double)err * err;
+		}
+		double snr = noise ? 10 * std::log10(signal / noise) : INFINITY;
+		uint32_t block = at / (2 * BUFFER_SIZE / decimate);
+
+		if (snr < sc.min_snr || worst > sc.max_error) {
+			printf("%-16s FAIL SNR %.1f dB (min %.0f), max error %d at block %u (max %d)\n",
+				sc.name, snr, sc.min_snr, worst, block, sc.max_error);
+			++failures;
+		} else {
+			printf("%-16s ok (SNR %.1f dB, max error %d)\n", sc.name, snr, worst);
+		}
+	}
+
+	return failures ? 1 : 0;
+}
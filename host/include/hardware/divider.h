@@ -0,0 +1,30 @@
+#pragma once
+
+// The hardware divider, as plain division.
+
+#include "pico.h"
+
+typedef uint64_t divmod_result_t;
+
+extern thread_local divmod_result_t hw_divider_last_result;
+
+static inline void hw_divider_divmod_s32_start(int32_t a, int32_t b)
+{
+	uint32_t q = (uint32_t)(a / b), r = (uint32_t)(a % b);
+	hw_divider_last_result = ((uint64_t)r << 32) | q;
+}
+
+static inline divmod_result_t hw_divider_result_wait(void)
+{
+	return hw_divider_last_result;
+}
+
+static inline int32_t to_quotient_s32(divmod_result_t r)
+{
+	return (int32_t)(uint32_t)r;
+}
+
+static inline int32_t hw_divider_quotient_s32(int32_t a, int32_t b)
+{
+	return a / b;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Software model of the RP2040 interpolator, covering the lane
+// shift / mask / add_raw modes and the pop registers the engine uses.
+// State is per thread, as the real interpolators are per core.
+
+#include "pico.h"
+
+typedef struct {
+	uint32_t ctrl;
+} interp_config;
+
+struct interp_hw_t;
+
+struct interp_pop_t {
+	interp_hw_t* hw;
+	uintptr_t operator[](int i) const;
+};
+
+struct interp_hw_t {
+	uint32_t accum[2];
+	uintptr_t base[3];
+	interp_pop_t pop;
+	interp_pop_t peek;
+	interp_config cfg[2];
+	interp_hw_t() : accum{0, 0}, base{0, 0, 0}, pop{this}, peek{nullptr}, cfg{{0}, {0}} {}
+	uint32_t lane(int n) const;
+};
+
+inline uint32_t interp_hw_t::lane(int n) const
+{
+	uint32_t c = cfg[n].ctrl;
+	uint32_t shift = c & 0x1f;
+	uint32_t lsb = (c >> 5) & 0x1f;
+	uint32_t msb = (c >> 10) & 0x1f;
+	uint32_t mask = (msb == 31 ? 0xffffffffu : ((2u << msb) - 1)) & ~((1u << lsb) - 1);
+	return (accum[n] >> shift) & mask;
+}
+
+inline uintptr_t interp_pop_t::operator[](int i) const
+{
+	uint32_t sm0 = hw->lane(0), sm1 = hw->lane(1);
+	uint32_t r0 = (uint32_t)hw->base[0] + ((hw->cfg[0].ctrl & (1u << 18)) ? hw->accum[0] : sm0);
+	uint32_t r1 = (uint32_t)hw->base[1] + ((hw->cfg[1].ctrl & (1u << 18)) ? hw->accum[1] : sm1);
+	uintptr_t full = hw->base[2] + sm0 + sm1;
+	hw->accum[0] = r0;
+	hw->accum[1] = r1;
+	return i == 0 ? r0 : i == 1 ? r1 : full;
+}
+
+extern thread_local interp_hw_t interp_hw_array[2];
+
+#define interp0 (&interp_hw_array[0])
+#define interp1 (&interp_hw_array[1])
+
+static inline interp_config interp_default_config()
+{
+	interp_config c = { 31u << 10 };
+	return c;
+}
+
+static inline void interp_config_set_shift(interp_config* c, uint shift)
+{
+	c->ctrl = (c->ctrl & ~0x1fu) | (shift & 0x1f);
+}
+
+static inline void interp_config_set_mask(interp_config* c, uint lsb, uint msb)
+{
+	c->ctrl = (c->ctrl & ~(0x3ffu << 5)) | ((lsb & 0x1f) << 5) | ((msb & 0x1f) << 10);
+}
+
+static inline void interp_config_set_add_raw(interp_config* c, bool add_raw)
+{
+	c->ctrl = (c->ctrl & ~(1u << 18)) | (add_raw ? (1u << 18) : 0);
+}
+
+static inline void interp_set_config(interp_hw_t* interp, uint lane, interp_config* config)
+{
+	interp->cfg[lane] = *config;
+}
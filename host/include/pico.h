@@ -0,0 +1,20 @@
+#pragma once
+
+// Host build stand-ins for the parts of the Pico SDK used by the
+// synth engine, so that it can be built and tested off-device.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define PICO_ON_DEVICE 0
+
+typedef unsigned int uint;
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
+
+static inline void tight_loop_contents(void) {}
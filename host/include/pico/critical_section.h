@@ -0,0 +1,32 @@
+#pragma once
+
+// Critical sections, as mutexes.
+
+#include <mutex>
+
+#include "pico.h"
+
+typedef struct {
+	std::mutex* mutex;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t* crit_sec)
+{
+	crit_sec->mutex = new std::mutex;
+}
+
+static inline void critical_section_enter_blocking(critical_section_t* crit_sec)
+{
+	crit_sec->mutex->lock();
+}
+
+static inline void critical_section_exit(critical_section_t* crit_sec)
+{
+	crit_sec->mutex->unlock();
+}
+
+static inline void critical_section_deinit(critical_section_t* crit_sec)
+{
+	delete crit_sec->mutex;
+	crit_sec->mutex = nullptr;
+}
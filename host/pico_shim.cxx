@@ -0,0 +1,6 @@
+#include "hardware/interp.h"
+#include "hardware/divider.h"
+
+// per-thread, as the real hardware is per-core
+thread_local interp_hw_t interp_hw_array[2];
+thread_local divmod_result_t hw_divider_last_result;
@@ -0,0 +1,430 @@
+//
+// Floating-point reference renderer
+//
+// Renders test notes on each preset through the fixed-point engine and
+// through a double-precision model of the same voice, then reports:
+//
+// - the SNR of the 16-bit output, and of the mix bus before the final
+//   output shift, with the reference retuned to the engine's pitch so
+//   that pitch error isn't counted as noise
+// - the pitch error in cents, measured from the rising zero crossings
+//   of each render over the sustain
+// - the envelope error, as the worst per-block RMS level difference in
+//   dB over blocks within 40 dB of the note's peak
+//
+// The model covers DCO1 and DCO2 on the basic waves, both envelopes,
+// pitch bend, velocity, volume, and pan with key follow.  Notes are
+// played with the controllers at their defaults, so wheel and pressure
+// modulation are inactive.  Presets using unison, wavetable scanning,
+// mono mode, autopan or other modulation routes are reported as not
+// modelled.  Random pan spread is switched off, as the reference can't
+// follow the engine's random number generator.
+//
+// usage: reference [--budget <min SNR> <min bus SNR> <max cents> <max envelope dB>]
+//
+// With a budget, exits with an error if any note falls outside it.  The
+// SNR limits apply to the whole note at the output, and to the sustain
+// on the mix bus, which isolates the engine's arithmetic from the final
+// output shift and the block-rate envelope.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "midi.h"
+
+//--------------------------------------------------------------------+
+// Test notes
+//--------------------------------------------------------------------+
+
+struct Test {
+	uint8_t		note;
+	int16_t		bend;				// -8192 ..< 8192, over the default 2 semitones
+};
+
+static const Test tests[] = {
+	{ 36, 0 },
+	{ 60, 0 },
+	{ 84, 0 },
+	{ 60, 2731 },
+	{ 60, -4096 },
+};
+
+static const uint8_t npresets = 4;
+static const uint8_t velocity = 100;
+static const uint8_t bend_range = 2;
+
+static const uint32_t hold_blocks = 1500 * SAMPLE_RATE / 1000 / BUFFER_SIZE;
+
+struct Result {
+	double		snr;				// dB, 16-bit output, whole note
+	double		snr_sustain;		// dB, 16-bit output, sustain only
+	double		snr_bus;			// dB, mix bus, sustain only
+	double		cents;
+	double		env;				// dB
+};
+
+//--------------------------------------------------------------------+
+// Reference voice model
+//--------------------------------------------------------------------+
+
+// the normalised exponential segment shape used by the envelopes,
+// from 1.0 at the start to 0.0 at the end
+static double curve(double x)
+{
+	const double k = 5.0;
+	return (exp(-k * x) - exp(-k)) / (1 - exp(-k));
+}
+
+// ADSR level at time t (seconds) for a gate released at `off`, with
+// segment times in milliseconds and a 7-bit sustain level
+static double adsr(double t, double off, uint16_t a, uint16_t d, uint8_t s, uint16_t r)
+{
+	double sustain = s / 128.0;
+
+	auto gated = [&](double t) {
+		double ta = a / 1000.0, td = d / 1000.0;
+		if (t < ta) {
+			return 1 - curve(t / ta);
+		}
+		t -= ta;
+		if (t < td) {
+			return sustain + (1 - sustain) * curve(t / td);
+		}
+		return sustain;
+	};
+
+	if (t < off) {
+		return gated(t);
+	}
+
+	double tr = r / 1000.0;
+	t -= off;
+	return (t < tr) ? gated(off) * curve(t / tr) : 0;
+}
+
+// the basic waves, at phase 0 ..< 1, in the shapes of the wave tables
+static double wave(uint8_t w, double ph)
+{
+	switch (w) {
+		case 0:
+			return sin(2 * M_PI * ph);
+		case 1:
+			return (ph < 0.5) ? 1 : -1;
+		case 2:
+			return 1 - 2 * ph;
+		default:
+			return (ph < 0.25) ? 4 * ph : (ph < 0.75) ? 2 - 4 * ph : 4 * ph - 4;
+	}
+}
+
+static bool modelled(const Patch& p)
+{
+	if (p.unison > 1 || p.wt_source || p.mono || p.pan_lfo) return false;
+	if (p.dco_wave > 3 || (p.dco2_level && p.dco2_wave > 3)) return false;
+
+	for (auto& r : p.mod) {
+		if (r.source == MOD_NONE || r.amount == 0) continue;
+		if (r.source != MOD_WHEEL && r.source != MOD_PRESSURE) return false;
+	}
+	return true;
+}
+
+// renders the note as interleaved stereo in the scale of the engine's
+// mix bus, with each DCO's frequency multiplied by `ratio`
+static void render_reference(const Patch& p, const Test& t, double ratio,
+	size_t n, size_t off, std::vector<double>& out)
+{
+	out.resize(2 * n);
+
+	double t_off = (double)off / SAMPLE_RATE;
+
+	// the engine's gain chain at full scale - 15-bit envelope, 7-bit
+	// level, velocity and volume, 7-bit pan and 16-bit waves, then
+	// the shifts back down to the mix bus
+	double pan = 64 + (t.note - 60) * p.pan_key / 16.0;
+	if (pan < 0) pan = 0;
+	if (pan > 127) pan = 127;
+	double gain = 32768.0 * p.dca_env_level * velocity * 127 / 2048 / 65536 * 32768 / 65536;
+	double gain_l = gain * 127 * sqrt((127 - pan) / 127);
+	double gain_r = gain * 127 * sqrt(pan / 127);
+
+	double semis = t.note - 69 + (double)t.bend * bend_range / 8192;
+	double f1 = 440 * pow(2, semis / 12) * ratio / SAMPLE_RATE;
+	double f2 = f1 * pow(2, (p.dco2_coarse * 100 + p.dco2_fine) / 1200.0);
+
+	double l2 = (p.dco2_level < 128 ? p.dco2_level : 128) / 128.0;
+	double l1 = 1 - l2;
+	double ph1 = 0, ph2 = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		double time = (double)i / SAMPLE_RATE;
+
+		double s = wave(p.dco_wave, ph1);
+		if (p.dco2_level) {
+			s = s * l1 + wave(p.dco2_wave, ph2) * l2;
+		}
+
+		double env = adsr(time, t_off, p.dca_env_a, p.dca_env_d, p.dca_env_s, p.dca_env_r);
+		out[2 * i] = env * gain_l * s;
+		out[2 * i + 1] = env * gain_r * s;
+
+		// the DCO envelope at full level bends up by half an octave
+		double mul = 1;
+		if (p.dco_env_level) {
+			double e = adsr(time, t_off, p.dco_env_a, p.dco_env_d, p.dco_env_s, p.dco_env_r);
+			mul = pow(2, e * p.dco_env_level / 256);
+		}
+
+		ph1 += f1 * mul;
+		ph1 -= floor(ph1);
+		ph2 += f2 * mul;
+		ph2 -= floor(ph2);
+	}
+}
+
+//--------------------------------------------------------------------+
+// Fixed-point render
+//--------------------------------------------------------------------+
+
+// renders the note through the engine, returning the mix bus
+static void render_fixed(uint8_t preset, const Test& t, uint32_t blocks,
+	std::vector<int32_t>& bus)
+{
+	auto* engine = new SynthEngine();
+	static int32_t samples[2 * BUFFER_SIZE];
+
+	engine->midi_in(0xc0, preset, 0);
+	if (t.bend) {
+		uint16_t v = t.bend + 8192;
+		engine->midi_in(0xe0, v & 0x7f, v >> 7);
+	}
+	engine->midi_in(0x90, t.note, velocity);
+
+	bus.clear();
+	for (uint32_t b = 0; b < blocks; ++b) {
+		if (b == hold_blocks) {
+			engine->midi_in(0x80, t.note, 0);
+		}
+		memset(samples, 0, sizeof(samples));
+		engine->update(samples, BUFFER_SIZE);
+		bus.insert(bus.end(), samples, samples + 2 * BUFFER_SIZE);
+	}
+
+	delete engine;
+}
+
+//--------------------------------------------------------------------+
+// Analysis
+//--------------------------------------------------------------------+
+
+// the mean period in samples of the left channel over [from, to), by
+// a least squares fit of its rising zero crossing times
+template <typename T>
+static double period(const std::vector<T>& x, size_t from, size_t to)
+{
+	double sk = 0, st = 0, skk = 0, skt = 0;
+	uint32_t k = 0;
+
+	for (size_t i = from + 1; i < to; ++i) {
+		double a = x[2 * i - 2], b = x[2 * i];
+		if (a < 0 && b >= 0) {
+			double t = i - 1 + a / (a - b);
+			sk += k;
+			st += t;
+			skk += (double)k * k;
+			skt += k * t;
+			++k;
+		}
+	}
+
+	if (k < 2) return 0;
+	return (k * skt - sk * st) / (k * skk - sk * sk);
+}
+
+static inline double output(double bus)
+{
+	return floor(bus / 64);
+}
+
+// SNR in dB over samples [from, to), at the 16-bit output or the bus,
+// after matching the reference's level on each side so that small
+// static gain errors don't mask the noise floor
+static double snr(const std::vector<double>& ref, const std::vector<int32_t>& bus,
+	size_t from, size_t to, bool out)
+{
+	double sig = 0, noise = 0;
+	for (size_t c = 0; c < 2; ++c) {
+		double rr = 0, rf = 0;
+		for (size_t i = 2 * from + c; i < 2 * to; i += 2) {
+			double r = out ? ref[i] / 64 : ref[i];
+			double f = out ? output(bus[i]) : bus[i];
+			rr += r * r;
+			rf += r * f;
+		}
+		double g = rr ? rf / rr : 1;
+
+		for (size_t i = 2 * from + c; i < 2 * to; i += 2) {
+			double r = g * (out ? ref[i] / 64 : ref[i]);
+			double f = out ? output(bus[i]) : bus[i];
+			sig += r * r;
+			noise += (f - r) * (f - r);
+		}
+	}
+	return noise ? 10 * log10(sig / noise) : INFINITY;
+}
+
+// the worst per-block level difference in dB, over the blocks that are
+// within 40 dB of the loudest
+static double envelope_error(const std::vector<double>& ref, const std::vector<int32_t>& bus)
+{
+	size_t blocks = ref.size() / (2 * BUFFER_SIZE);
+	std::vector<double> rr(blocks), rf(blocks);
+	double peak = 0;
+
+	for (size_t b = 0; b < blocks; ++b) {
+		double er = 0, ef = 0;
+		for (size_t i = 2 * BUFFER_SIZE * b; i < 2 * BUFFER_SIZE * (b + 1); ++i) {
+			er += ref[i] * ref[i];
+			ef += (double)bus[i] * bus[i];
+		}
+		rr[b] = sqrt(er);
+		rf[b] = sqrt(ef);
+		if (rr[b] > peak) peak = rr[b];
+	}
+
+	double worst = 0;
+	for (size_t b = 0; b < blocks; ++b) {
+		if (rr[b] < peak / 100) continue;
+		double e = fabs(20 * log10((rf[b] + 1e-9) / rr[b]));
+		if (e > worst) worst = e;
+	}
+	return worst;
+}
+
+static Result analyse(const Patch& p, const Test& t, uint8_t preset)
+{
+	uint32_t release = (p.dca_env_r + 100) * SAMPLE_RATE / 1000 / BUFFER_SIZE;
+	uint32_t blocks = hold_blocks + release;
+	size_t n = blocks * BUFFER_SIZE;
+	size_t off = hold_blocks * BUFFER_SIZE;
+
+	std::vector<int32_t> bus;
+	std::vector<double> ref;
+	render_fixed(preset, t, blocks, bus);
+	render_reference(p, t, 1.0, n, off, ref);
+
+	// pitch, measured over the sustain
+	size_t from = (p.dca_env_a + p.dca_env_d + p.dco_env_a + p.dco_env_d) *
+		SAMPLE_RATE / 1000 + BUFFER_SIZE;
+	double pr = period(ref, from, off);
+	double pf = period(bus, from, off);
+
+	Result res;
+	res.cents = (pr && pf) ? 1200 * log2(pr / pf) : NAN;
+
+	// retune the reference to the measured pitch, then search around it
+	// for the best alignment over the sustain, coarsely then finely, as
+	// the crossings of waves with steps are only known to within a sample
+	double ratio = (pr && pf) ? pr / pf : 1.0;
+	double best = ratio, best_snr = -INFINITY;
+	for (double step : { 1e-6, 3e-8 }) {
+		double centre = best;
+		for (int i = -32; i <= 32; ++i) {
+			double r = centre * (1 + i * step);
+			render_reference(p, t, r, n, off, ref);
+			double s = snr(ref, bus, from, off, false);
+			if (s > best_snr) {
+				best_snr = s;
+				best = r;
+			}
+		}
+	}
+
+	render_reference(p, t, best, n, off, ref);
+	res.snr_bus = best_snr;
+	res.snr = snr(ref, bus, 0, n, true);
+	res.snr_sustain = snr(ref, bus, from, off, true);
+	res.env = envelope_error(ref, bus);
+	return res;
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [--budget <min SNR> <min bus SNR> <max cents> <max envelope dB>]\n", prog);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	bool check = false;
+	double min_snr = 0, min_snr_bus = 0, max_cents = 0, max_env = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--budget" && i + 4 < argc) {
+			check = true;
+			min_snr = atof(argv[++i]);
+			min_snr_bus = atof(argv[++i]);
+			max_cents = atof(argv[++i]);
+			max_env = atof(argv[++i]);
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	// the reference can't follow the engine's random pan placement
+	for (uint8_t i = 0; i < npresets; ++i) {
+		presets[i].pan_spread = 0;
+	}
+
+	uint32_t failures = 0;
+
+	printf("preset,note,bend,snr_db,snr_sustain_db,snr_bus_db,pitch_cents,env_err_db\n");
+
+	for (uint8_t i = 0; i < npresets; ++i) {
+		auto& p = presets[i];
+		if (!modelled(p)) {
+			printf("%u,,,not modelled\n", i);
+			continue;
+		}
+
+		Result worst = { INFINITY, INFINITY, INFINITY, 0, 0 };
+		for (auto& t : tests) {
+			auto r = analyse(p, t, i);
+			printf("%u,%u,%d,%.1f,%.1f,%.1f,%.3f,%.3f\n", i, t.note, t.bend,
+				r.snr, r.snr_sustain, r.snr_bus, r.cents, r.env);
+
+			worst.snr = fmin(worst.snr, r.snr);
+			worst.snr_sustain = fmin(worst.snr_sustain, r.snr_sustain);
+			worst.snr_bus = fmin(worst.snr_bus, r.snr_bus);
+			worst.cents = fmax(worst.cents, fabs(r.cents));
+			worst.env = fmax(worst.env, r.env);
+
+			if (check && !(r.snr >= min_snr && r.snr_bus >= min_snr_bus &&
+				fabs(r.cents) <= max_cents && r.env <= max_env))
+			{
+				++failures;
+			}
+		}
+
+		printf("# preset %u worst: SNR %.1f dB (sustain %.1f dB, bus %.1f dB), "
+			"pitch %.3f cents, envelope %.3f dB\n", i, worst.snr,
+			worst.snr_sustain, worst.snr_bus, worst.cents, worst.env);
+	}
+
+	if (check) {
+		printf("%s: %u notes outside the budget\n", failures ? "FAIL" : "PASS", failures);
+	}
+
+	return failures ? 1 : 0;
+}
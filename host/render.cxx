@@ -0,0 +1,261 @@
+//
+// Batch renderer for MIDI file corpora
+//
+// Renders every file with every selected preset, one job per pair, on
+// a pool of threads each with its own engine instance.  Reports the
+// real-time factor of each job and of the whole run, per core.
+//
+// usage: render [-j threads] [-p first-last] [-o wav dir] file.mid ...
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "effects.h"
+#include "smf.h"
+
+//--------------------------------------------------------------------+
+// Jobs
+//--------------------------------------------------------------------+
+
+struct Job {
+	std::string		path;
+	uint8_t			preset;
+
+	// results
+	bool			ok = false;
+	std::string		error;
+	double			audio = 0;		// seconds of audio rendered
+	double			wall = 0;		// seconds taken
+};
+
+// release tail rendered after the last event
+static const uint32_t tail = 2 * SAMPLE_RATE;
+
+static std::string wav_dir;
+
+//--------------------------------------------------------------------+
+// WAV output
+//--------------------------------------------------------------------+
+
+static void put16(FILE* f, uint16_t v)
+{
+	fputc(v & 0xff, f);
+	fputc(v >> 8, f);
+}
+
+static void put32(FILE* f, uint32_t v)
+{
+	put16(f, v & 0xffff);
+	put16(f, v >> 16);
+}
+
+static bool write_wav(const std::string& path, const std::vector<int16_t>& pcm)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+
+	uint32_t bytes = pcm.size() * 2;
+	fwrite("RIFF", 1, 4, f);
+	put32(f, 36 + bytes);
+	fwrite("WAVEfmt ", 1, 8, f);
+	put32(f, 16);
+	put16(f, 1);						// PCM
+	put16(f, 2);						// stereo
+	put32(f, SAMPLE_RATE);
+	put32(f, SAMPLE_RATE * 4);
+	put16(f, 4);
+	put16(f, 16);
+	fwrite("data", 1, 4, f);
+	put32(f, bytes);
+
+	for (auto s : pcm) {
+		put16(f, s);
+	}
+
+	return fclose(f) == 0;
+}
+
+static std::string basename(const std::string& path)
+{
+	auto slash = path.find_last_of('/');
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	auto dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+//--------------------------------------------------------------------+
+// Rendering
+//--------------------------------------------------------------------+
+
+static void render(Job& job)
+{
+	Smf smf;
+	if (!smf.load(job.path, SAMPLE_RATE)) {
+		job.error = smf.error;
+		return;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	auto* engine = new SynthEngine();
+	auto* fx = new Effects();
+
+	// every channel plays the job's preset, whatever the file asks for
+	for (uint8_t c = 0; c < 16; ++c) {
+		engine->midi_in(0xc0 | c, job.preset, 0);
+	}
+
+	int32_t samples[2 * BUFFER_SIZE];
+	int32_t chorus[BUFFER_SIZE];
+	int32_t reverb[BUFFER_SIZE];
+
+	std::vector<int16_t> pcm;
+	bool keep = !wav_dir.empty();
+
+	uint64_t end = smf.length + tail;
+	size_t next = 0;
+
+	for (uint64_t t = 0; t < end; t += BUFFER_SIZE) {
+
+		// events are applied at the start of the block they fall in
+		while (next < smf.events.size() && smf.events[next].time < t + BUFFER_SIZE) {
+			auto& e = smf.events[next++];
+			if ((e.status & 0xf0) == 0xc0) continue;
+			engine->midi_in(e.status, e.d1, e.d2);
+		}
+
+		memset(samples, 0, sizeof(samples));
+		memset(chorus, 0, sizeof(chorus));
+		memset(reverb, 0, sizeof(reverb));
+		engine->update(samples, BUFFER_SIZE, chorus, reverb);
+		fx->process(samples, chorus, reverb, BUFFER_SIZE);
+
+		if (keep) {
+			for (size_t i = 0; i < 2 * BUFFER_SIZE; ++i) {
+				pcm.push_back(clamp16(samples[i] >> 6));
+			}
+		}
+	}
+
+	delete fx;
+	delete engine;
+
+	auto t1 = std::chrono::steady_clock::now();
+	job.wall = std::chrono::duration<double>(t1 - t0).count();
+	job.audio = (double)end / SAMPLE_RATE;
+	job.ok = true;
+
+	if (keep) {
+		auto path = wav_dir + "/" + basename(job.path) + "-" +
+			std::to_string(job.preset) + ".wav";
+		if (!write_wav(path, pcm)) {
+			job.ok = false;
+			job.error = "cannot write " + path;
+		}
+	}
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-p first-last] [-o wav dir] file.mid ...\n", prog);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threads = std::thread::hardware_concurrency();
+	unsigned first = 0, last = 3;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (arg == "-p" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%u-%u", &first, &last) == 1) {
+				last = first;
+			}
+		} else if (arg == "-o" && i + 1 < argc) {
+			wav_dir = argv[++i];
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	if (files.empty() || first > last) usage(argv[0]);
+	if (threads < 1) threads = 1;
+
+	std::vector<Job> jobs;
+	for (auto& f : files) {
+		for (unsigned p = first; p <= last; ++p) {
+			jobs.push_back({ f, (uint8_t)p });
+		}
+	}
+
+	if (threads > jobs.size()) threads = jobs.size();
+
+	std::atomic<size_t> next(0);
+	std::mutex print;
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; ++i) {
+		pool.emplace_back([&]() {
+			size_t j;
+			while ((j = next++) < jobs.size()) {
+				auto& job = jobs[j];
+				render(job);
+
+				std::lock_guard<std::mutex> lock(print);
+				if (job.ok) {
+					printf("%s preset %u: %.1f s audio in %.2f s, %.1fx real time\n",
+						job.path.c_str(), job.preset, job.audio, job.wall,
+						job.audio / job.wall);
+				} else {
+					printf("%s preset %u: FAIL %s\n",
+						job.path.c_str(), job.preset, job.error.c_str());
+				}
+			}
+		});
+	}
+
+	for (auto& t : pool) {
+		t.join();
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+	double wall = std::chrono::duration<double>(t1 - t0).count();
+
+	double audio = 0, busy = 0;
+	unsigned failures = 0;
+	for (auto& job : jobs) {
+		audio += job.audio;
+		busy += job.wall;
+		failures += !job.ok;
+	}
+
+	printf("%zu jobs on %u threads: %.1f s audio in %.2f s\n",
+		jobs.size(), threads, audio, wall);
+	if (busy > 0) {
+		printf("real-time factor %.1fx overall, %.1fx per core\n",
+			audio / wall, audio / busy);
+	}
+
+	return failures ? 1 : 0;
+}
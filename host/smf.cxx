@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "smf.h"
+
+//--------------------------------------------------------------------+
+// Byte stream helpers
+//--------------------------------------------------------------------+
+
+namespace {
+
+struct Reader {
+	const uint8_t*	p;
+	const uint8_t*	end;
+	bool			overrun = false;
+
+	uint8_t byte()
+	{
+		if (p >= end) {
+			overrun = true;
+			return 0;
+		}
+		return *p++;
+	}
+
+	uint32_t be(uint8_t n)
+	{
+		uint32_t v = 0;
+		while (n--) {
+			v = (v << 8) | byte();
+		}
+		return v;
+	}
+
+	// variable length quantity
+	uint32_t vlq()
+	{
+		uint32_t v = 0;
+		for (uint8_t i = 0; i < 4; ++i) {
+			uint8_t b = byte();
+			v = (v << 7) | (b & 0x7f);
+			if (!(b & 0x80)) break;
+		}
+		return v;
+	}
+
+	void skip(uint32_t n)
+	{
+		if (n > (uint32_t)(end - p)) {
+			overrun = true;
+			p = end;
+		} else {
+			p += n;
+		}
+	}
+};
+
+// an event in ticks, before the tempo map is applied
+struct TickEvent {
+	uint64_t		tick;
+	uint32_t		order;			// keeps simultaneous events in file order
+	uint8_t			status;
+	uint8_t			d1;
+	uint8_t			d2;
+	uint32_t		tempo;			// for tempo changes (status 0xff)
+};
+
+}
+
+//--------------------------------------------------------------------+
+// File loading
+//--------------------------------------------------------------------+
+
+bool Smf::load(const std::string& path, uint32_t sample_rate)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		error = "cannot open file";
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+		std::istreambuf_iterator<char>());
+	Reader r = { data.data(), data.data() + data.size() };
+
+	uint32_t magic = r.be(4);
+	uint32_t header_len = r.be(4);
+	if (magic != 0x4d546864 || header_len < 6) {	// "MThd"
+		error = "not a standard MIDI file";
+		return false;
+	}
+
+	uint16_t format = r.be(2);
+	uint16_t ntracks = r.be(2);
+	int16_t division = r.be(2);
+	r.skip(header_len - 6);							// any later fields
+
+	if (r.overrun) {
+		error = "truncated header";
+		return false;
+	}
+
+	if (format > 1) {
+		error = "unsupported format " + std::to_string(format);
+		return false;
+	}
+
+	// SMPTE time - frames per second and ticks per frame
+	uint8_t fps = (division < 0) ? -(division >> 8) : 0;
+	uint8_t tpf = (division < 0) ? (division & 0xff) : 0;
+	if (division < 0 ? !fps || !tpf : !division) {
+		error = "bad time division";
+		return false;
+	}
+
+	std::vector<TickEvent> ticks;
+	uint32_t order = 0;
+
+	for (uint16_t t = 0; t < ntracks && !r.overrun; ++t) {
+		uint32_t id = r.be(4);
+		uint32_t len = r.be(4);
+		if (id != 0x4d54726b) {						// "MTrk"
+			r.skip(len);
+			continue;
+		}
+
+		Reader tr = { r.p, r.p + std::min<size_t>(len, r.end - r.p) };
+		r.skip(len);
+
+		uint64_t tick = 0;
+		uint8_t running = 0;
+
+		while (tr.p < tr.end && !tr.overrun) {
+			tick += tr.vlq();
+
+			uint8_t status = tr.byte();
+			if (status < 0x80) {
+				// running status, re-use the byte as data
+				if (!running) {
+					error = "data byte without status";
+					return false;
+				}
+				--tr.p;
+				status = running;
+			}
+
+			// meta and SysEx events cancel running status
+			if (status >= 0xf0) {
+				running = 0;
+			}
+
+			if (status == 0xff) {
+				uint8_t type = tr.byte();
+				uint32_t n = tr.vlq();
+				if (type == 0x51 && n == 3) {
+					ticks.push_back({ tick, order++, 0xff, 0, 0, tr.be(3) });
+				} else if (type == 0x2f) {
+					break;
+				} else {
+					tr.skip(n);
+				}
+				continue;
+			}
+
+			if (status == 0xf0 || status == 0xf7) {
+				tr.skip(tr.vlq());
+				continue;
+			}
+
+			running = status;
+			uint8_t d1 = tr.byte();
+			uint8_t d2 = ((status & 0xe0) == 0xc0) ? 0 : tr.byte();
+			ticks.push_back({ tick, order++, status, d1, d2, 0 });
+		}
+
+		if (tr.overrun) {
+			error = "truncated track";
+			return false;
+		}
+	}
+
+	std::sort(ticks.begin(), ticks.end(), [](const TickEvent& a, const TickEvent& b) {
+		return a.tick < b.tick || (a.tick == b.tick && a.order < b.order);
+	});
+
+	// walk the tempo map, accumulating time in microseconds * ppq
+	// so that no rounding error builds up between tempo changes
+	uint64_t ppq = (division > 0) ? division : 0;
+	uint64_t us_per_tick_smpte = 0;
+	if (division < 0) {
+		us_per_tick_smpte = 1000000 / (fps * tpf);
+	}
+
+	uint32_t tempo = 500000;			// 120 bpm
+	uint64_t last_tick = 0;
+	uint64_t acc = 0;					// microseconds * ppq
+
+	for (auto& e : ticks) {
+		uint64_t dt = e.tick - last_tick;
+		last_tick = e.tick;
+		acc += ppq ? dt * tempo : dt * us_per_tick_smpte;
+
+		uint64_t us = ppq ? acc / ppq : acc;
+		uint64_t time = us * sample_rate / 1000000;
+
+		if (e.status == 0xff) {
+			tempo = e.tempo;
+		} else {
+			events.push_back({ time, e.status, e.d1, e.d2 });
+		}
+		length = time;
+	}
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Standard MIDI File reader, for formats 0 and 1
+//
+// All tracks are merged into a single list of channel voice messages,
+// timed in samples at the given sample rate using the file's tempo map.
+// SysEx and meta events other than tempo changes are skipped.
+//
+
+struct SmfEvent {
+	uint64_t				time;		// in samples
+	uint8_t					status;
+	uint8_t					d1;
+	uint8_t					d2;
+};
+
+class Smf {
+
+public:
+	std::vector<SmfEvent>	events;
+	uint64_t				length = 0;	// in samples
+	std::string				error;
+
+public:
+	bool					load(const std::string& path, uint32_t sample_rate);
+
+};
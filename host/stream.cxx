@@ -0,0 +1,85 @@
+//
+// Streaming runner - raw MIDI bytes on stdin, raw PCM on stdout
+//
+// Input is parsed with the same MidiParser as the device's serial port
+// and output is 16-bit little-endian stereo at SAMPLE_RATE.  Blocks are
+// rendered continuously, so the output consumer sets the pace, e.g.:
+//
+//   amidi -p hw:1 -d | stream | aplay -f S16_LE -c 2 -r 44100
+//
+// At the end of the input a short release tail is rendered, and the
+// parser's counters are reported on stderr.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "effects.h"
+#include "midi_parser.h"
+
+// release tail rendered at the end of the input, in blocks
+static const uint32_t tail = 2 * SAMPLE_RATE / BUFFER_SIZE;
+
+int main()
+{
+	auto* engine = new SynthEngine();
+	auto* fx = new Effects();
+	MidiParser parser;
+
+	static int32_t samples[2 * BUFFER_SIZE];
+	static int32_t chorus[BUFFER_SIZE];
+	static int32_t reverb[BUFFER_SIZE];
+	static int16_t out[2 * BUFFER_SIZE];
+
+	bool eof = false;
+	uint32_t remaining = tail;
+
+	while (!eof || remaining--) {
+
+		// take whatever input is waiting, without blocking
+		while (!eof) {
+			struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+			if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & (POLLIN | POLLHUP))) break;
+
+			uint8_t buf[256];
+			ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+			if (n <= 0) {
+				eof = true;
+				break;
+			}
+
+			for (ssize_t i = 0; i < n; ++i) {
+				if (parser.parse(buf[i]) == MidiParser::message) {
+					auto* p = parser.packet();
+					engine->midi_in(p[1], p[2], p[3]);
+				}
+			}
+		}
+
+		memset(samples, 0, sizeof(samples));
+		memset(chorus, 0, sizeof(chorus));
+		memset(reverb, 0, sizeof(reverb));
+		engine->update(samples, BUFFER_SIZE, chorus, reverb);
+		fx->process(samples, chorus, reverb, BUFFER_SIZE);
+
+		for (size_t i = 0; i < 2 * BUFFER_SIZE; ++i) {
+			out[i] = clamp16(samples[i] >> 6);
+		}
+
+		if (fwrite(out, sizeof(out), 1, stdout) != 1) break;
+	}
+
+	auto& c = parser.stats();
+	fprintf(stderr, "bytes %u messages %u sysex %u (%u overflowed) "
+		"stray data %u truncated %u\n",
+		c.bytes, c.messages, c.sysex, c.sysex_overflow,
+		c.stray_data, c.truncated);
+
+	delete fx;
+	delete engine;
+
+	return 0;
+}
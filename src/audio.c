@@ -1,6 +1,10 @@
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
 #include "audio.h"
 
+static const uint audio_sm = 0;
+
 struct audio_buffer_pool *audio_init() {
 
 	static audio_format_t audio_format = {
@@ -23,7 +27,7 @@ struct audio_buffer_pool *audio_init() {
 			.data_pin = PICO_AUDIO_I2S_DATA_PIN,
 			.clock_pin_base = PICO_AUDIO_I2S_CLOCK_PIN_BASE,
 			.dma_channel = 0,
-			.pio_sm = 0,
+			.pio_sm = audio_sm,
 	};
 
 	output_format = audio_i2s_setup(&audio_format, &config);
@@ -44,3 +48,12 @@ struct audio_buffer_pool *audio_init() {
 
 	return producer_pool;
 }
+
+// keeps the I2S sample rate after a change to the system clock, using
+// the same divider as pico_audio_i2s sets up
+void audio_clock_changed() {
+
+	uint32_t divider = clock_get_hz(clk_sys) * 4 / SAMPLE_RATE;
+	pio_sm_set_clkdiv_int_frac(__CONCAT(pio, PICO_AUDIO_I2S_PIO), audio_sm,
+		divider >> 8u, divider & 0xffu);
+}
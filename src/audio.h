@@ -8,6 +8,7 @@ extern "C" {
 #endif
 
 struct audio_buffer_pool *audio_init();
+void audio_clock_changed();
 
 #ifdef __cplusplus
 };
@@ -1,6 +1,18 @@
 #pragma once
 
+#include "pico.h"
+
+//
+// Block timing - in CPU cycles from SysTick on the device, and in
+// nanoseconds from the system clock in the host build
+//
+
+#if PICO_ON_DEVICE
+
 #include "hardware/structs/systick.h"
+#include "hardware/clocks.h"
+
+#define BENCH_UNIT "cycles"
 
 static inline void bench_init()
 {
@@ -22,3 +34,36 @@ static inline uint32_t bench_delta(uint32_t t0, uint32_t t1)
 		return t0 + 0x1000000 - t1;
 	}
 }
+
+static inline uint32_t bench_ticks_per_second()
+{
+	return clock_get_hz(clk_sys);
+}
+
+#else
+
+#include <chrono>
+
+#define BENCH_UNIT "ns"
+
+static inline void bench_init()
+{
+}
+
+static inline uint32_t bench_time()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static inline uint32_t bench_delta(uint32_t t0, uint32_t t1)
+{
+	return t1 - t0;
+}
+
+static inline uint32_t bench_ticks_per_second()
+{
+	return 1000000000;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+#include "bench_sweep.h"
+#include "engine.h"
+#include "midi.h"
+#include "midi_parser.h"
+
+static const uint8_t voice_counts[] = { 1, 2, 4, 8, 16, 32, 64, 96, 128 };
+static const uint16_t block_sizes[] = { 32, 64, 128, 256 };
+static const uint8_t npresets = 4;
+
+static const uint8_t warmup = 4;		// blocks rendered before timing
+static const uint8_t measured = 16;		// blocks timed
+
+static int32_t samples[2 * BUFFER_SIZE];
+
+// prints n / 100 with two decimal places
+static void print_x100(int64_t n)
+{
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	printf("%lu.%02lu", (unsigned long)(n / 100), (unsigned long)(n % 100));
+}
+
+void bench_sweep(SynthEngine& engine)
+{
+	bench_init();
+
+	uint64_t hz = bench_ticks_per_second();
+
+	printf("preset,block,voices,unit,min,max,per_voice_sample,headroom_pct\n");
+
+	for (uint8_t p = 0; p < npresets; ++p) {
+		engine.midi_in(0xc0, p, 0);
+
+		for (auto n : block_sizes) {
+			if (n > BUFFER_SIZE) continue;
+
+			// the time available to render one block in real time
+			uint64_t deadline = hz * n / SAMPLE_RATE;
+
+			for (auto nv : voice_counts) {
+				if (nv > MAX_VOICES) continue;
+				for (uint8_t i = 0; i < nv; ++i) {
+					engine.midi_in(0x90, i, 100);
+				}
+
+				uint32_t min = 0xffffffff, max = 0, voices = 0;
+				for (uint8_t b = 0; b < warmup + measured; ++b) {
+					memset(samples, 0, sizeof(samples));
+					uint32_t t0 = bench_time();
+					voices = engine.update(samples, n);
+					uint32_t t1 = bench_time();
+
+					if (b < warmup) continue;
+					uint32_t delta = bench_delta(t0, t1);
+					if (delta < min) min = delta;
+					if (delta > max) max = delta;
+				}
+
+				engine.midi_in(0xb0, all_sound_off, 0);
+
+				printf("%u,%u,%lu," BENCH_UNIT ",%lu,%lu,", p, n,
+					(unsigned long)voices, (unsigned long)min, (unsigned long)max);
+				print_x100(voices ? (uint64_t)min * 100 / (voices * n) : 0);
+				putchar(',');
+				print_x100(100 * 100 - (int64_t)max * 100 * 100 / deadline);
+				putchar('\n');
+			}
+		}
+	}
+
+	engine.midi_in(0xc0, 0, 0);
+}
+
+//--------------------------------------------------------------------+
+// MIDI parser
+//--------------------------------------------------------------------+
+
+// one second of a saturated serial link
+static const uint16_t stream_len = 31250 / 10;
+
+// fills the buffer with notes, controllers and bends using running
+// status, with clock bytes interleaved and the odd short SysEx
+static void make_stream(uint8_t* buf, uint16_t n)
+{
+	uint16_t i = 0;
+	uint32_t k = 0;
+	while (i < n) {
+		uint8_t r = (k++ * 7) % 10;
+		uint8_t tmp[8];
+		uint8_t len = 0;
+
+		if (r < 5) {				// note, with running status
+			if (r == 0) tmp[len++] = 0x90;
+			tmp[len++] = 36 + k % 48;
+			tmp[len++] = (k & 1) ? 100 : 0;
+		} else if (r < 7) {
+			tmp[len++] = 0xb0;
+			tmp[len++] = 1;
+			tmp[len++] = k & 0x7f;
+		} else if (r < 9) {
+			tmp[len++] = 0xe0;
+			tmp[len++] = k & 0x7f;
+			tmp[len++] = 64;
+		} else {
+			tmp[len++] = 0xf0;
+			tmp[len++] = 0x7e;
+			tmp[len++] = 0x7f;
+			tmp[len++] = 0x06;
+			tmp[len++] = 0x01;
+			tmp[len++] = 0xf7;
+		}
+
+		for (uint8_t j = 0; j < len && i < n; ++j) {
+			buf[i++] = tmp[j];
+
+			// a clock byte inside every eighth message
+			if (j == 0 && (k & 7) == 0 && i < n) {
+				buf[i++] = 0xf8;
+			}
+		}
+	}
+}
+
+void bench_parser()
+{
+	static uint8_t stream[stream_len];
+	static MidiParser parser;
+
+	bench_init();
+	make_stream(stream, stream_len);
+
+	uint32_t t0 = bench_time();
+	uint32_t messages = 0;
+	for (uint16_t i = 0; i < stream_len; ++i) {
+		messages += (parser.parse(stream[i]) != MidiParser::none);
+	}
+	uint32_t t1 = bench_time();
+	uint32_t delta = bench_delta(t0, t1);
+
+	// the share of a CPU needed to keep up with the wire
+	uint64_t hz = bench_ticks_per_second();
+
+	printf("parser,bytes,messages,unit,total,per_byte,load_pct\n");
+	printf("parser,%u,%lu," BENCH_UNIT ",%lu,", stream_len,
+		(unsigned long)messages, (unsigned long)delta);
+	print_x100((uint64_t)delta * 100 / stream_len);
+	putchar(',');
+	print_x100((uint64_t)delta * 100 * 100 / hz);
+	putchar('\n');
+}
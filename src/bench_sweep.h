@@ -0,0 +1,12 @@
+#pragma once
+
+class SynthEngine;
+
+// renders sustained notes on each preset across a range of voice counts
+// and block sizes, printing the timings as CSV - leaves all channels
+// silent and back on their default presets
+void bench_sweep(SynthEngine& engine);
+
+// times the serial MIDI parser over a second's worth of a busy
+// 31.25 kbaud stream, printing the cost per byte as CSV
+void bench_parser();
@@ -3,6 +3,15 @@
 #include "hardware/divider.h"
 #include "channel.h"
 #include "midi.h"
+#include "tables.h"
+
+// moves a smoothed 7.8 value a quarter of the way towards
+// a 7-bit target, rounding so that it always settles exactly
+static inline void slew(uint16_t& s, uint8_t target)
+{
+	int32_t d = (target << 8) - s;
+	s += (d > 0) ? (d + 3) >> 2 : d >> 2;
+}
 
 Channel::Channel() :
 	control{0, }
@@ -10,24 +19,87 @@ Channel::Channel() :
 	set_cc(volume, 127);
 	set_cc(pan, 64);
 	set_bend(0, 64);
+
+	// start with the smoothed state already settled
+	volume_s = controller(volume) << 8;
+	pan_s = controller(pan) << 8;
+	update();
 }
 
 void Channel::set_program(uint8_t n)
 {
 	program = n;
+
+	// compile the patch's modulation matrix down to its active routes
+	auto& p = presets[program % 4];
+	nroutes = 0;
+	for (auto& r : p.mod) {
+		if (r.source == MOD_NONE || r.amount == 0) continue;
+		if (r.source >= MOD_CC && cc_slot(r.source - MOD_CC) == no_slot) continue;
+		if (r.dest == DEST_FILTER) continue;
+		if (r.dest == DEST_WT_POSITION && p.wt_source == WT_OFF) continue;
+		routes[nroutes++] = r;
+	}
 }
 
 void Channel::set_cc(uint8_t cc, uint8_t v)
 {
-	control[cc] = v;
+	uint8_t s = cc_slot(cc);
+	if (s < nslots) {
+		control[s] = v;
+	}
 
-	if (cc == pan) {	// zero = hard left
-		extern uint8_t pan_table[];
-		pan_l = pan_table[127 - v];
-		pan_r = pan_table[v];
+	// track the selected RPN, which NRPN selection deselects
+	switch (cc) {
+		case rpn_msb:
+		case rpn_lsb:
+			rpn = (controller(rpn_msb) << 7) | controller(rpn_lsb);
+			break;
+		case nrpn_msb:
+		case nrpn_lsb:
+			rpn = rpn_null;
+			break;
+		case data_entry_msb:
+			data_entry(v);
+			break;
 	}
 }
 
+// applies a data entry MSB to the selected RPN
+void Channel::data_entry(uint8_t v)
+{
+	switch (rpn) {
+		case rpn_bend_range:
+			set_bend_range(v);
+			break;
+	}
+}
+
+// resets controllers as per MIDI RP-015, leaving volume and pan alone
+void Channel::reset_controllers()
+{
+	set_cc(modwheel, 0);
+	set_cc(expression, 127);
+	set_cc(sustain, 0);
+	set_cc(portamento, 0);
+	set_cc(sostenuto, 0);
+	set_bend(0, 64);
+	pressure = 0;
+	rpn = rpn_null;
+}
+
+// called once per block to smooth volume and pan changes
+void Channel::update()
+{
+	slew(volume_s, controller(volume));
+	slew(pan_s, controller(pan));
+
+	// zero = hard left
+	uint8_t p = pan_s >> 8;
+	pan_l = pan_table[127 - p];
+	pan_r = pan_table[p];
+}
+
 void Channel::set_bend(uint8_t lsb, uint8_t msb)
 {
 	bend = (int16_t)((msb << 7) | lsb) - 8192;
@@ -41,6 +113,15 @@ void Channel::set_bend(uint8_t lsb, uint8_t msb)
 	}
 }
 
+void Channel::set_bend_range(uint8_t semitones)
+{
+	bend_range = semitones;
+
+	// force the scaled bend to be recalculated
+	bend_x = ~bend;
+	set_bend(bend & 0x7f, (bend + 8192) >> 7);
+}
+
 void Channel::midi_in(uint8_t c, uint8_t d1, uint8_t d2)
 {
 	uint8_t cmd = c >> 4;
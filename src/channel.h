@@ -2,27 +2,127 @@
 
 #include <cstdint>
 
+#include "midi.h"
+#include "patch.h"
+
+// the voice number used for no voice at all
+static const uint8_t		no_voice = 0xff;
+
+// the controllers a channel keeps - those the engine reads, and a few
+// general purpose ones for use as modulation sources - each with a slot
+// in Channel::control.  Any others are ignored.
+enum CCSlot : uint8_t {
+	slot_modwheel,
+	slot_breath,
+	slot_foot,
+	slot_volume,
+	slot_pan,
+	slot_expression,
+	slot_general_1,
+	slot_general_2,
+	slot_general_3,
+	slot_general_4,
+	slot_sustain,
+	slot_portamento,
+	slot_sostenuto,
+	slot_brightness,
+	slot_reverb_send,
+	slot_chorus_send,
+	slot_rpn_lsb,
+	slot_rpn_msb,
+	nslots,
+	no_slot = 0xff
+};
+
+constexpr uint8_t cc_slot(uint8_t cc)
+{
+	switch (cc) {
+		case modwheel:		return slot_modwheel;
+		case breath:		return slot_breath;
+		case foot:			return slot_foot;
+		case volume:		return slot_volume;
+		case pan:			return slot_pan;
+		case expression:	return slot_expression;
+		case general_1:		return slot_general_1;
+		case general_2:		return slot_general_2;
+		case general_3:		return slot_general_3;
+		case general_4:		return slot_general_4;
+		case sustain:		return slot_sustain;
+		case portamento:	return slot_portamento;
+		case sostenuto:		return slot_sostenuto;
+		case brightness:	return slot_brightness;
+		case reverb_send:	return slot_reverb_send;
+		case chorus_send:	return slot_chorus_send;
+		case rpn_lsb:		return slot_rpn_lsb;
+		case rpn_msb:		return slot_rpn_msb;
+		default:			return no_slot;
+	}
+}
+
 class Channel {
 
 	friend class			SynthEngine;
 
+	static const uint16_t	rpn_null = 0x3fff;
+
 private:
 	void					set_program(uint8_t program);
 	void					set_cc(uint8_t cc, uint8_t value);
 	void					set_bend(uint8_t lsb, uint8_t msb);
+	void					set_bend_range(uint8_t semitones);
+	void					data_entry(uint8_t value);
+	void					update();
+	void					reset_controllers();
+
+	// the controller's value, or zero if it isn't kept
+	inline uint8_t controller(uint8_t cc) const
+	{
+		uint8_t s = cc_slot(cc);
+		return s < nslots ? control[s] : 0;
+	}
 
 private:					// state mirroring MIDI values
-	const uint8_t			bend_range = 2;
+	uint8_t					bend_range = 2;
 	int16_t					bend = 0;
-	uint8_t					control[128];
-	uint8_t					pressure;
+	uint8_t					control[nslots];
+	uint8_t					pressure = 0;
 	uint8_t					program;
+	uint16_t				rpn = rpn_null;		// selected registered parameter
 
 private:					// calculated state
-	int16_t					bend_f;
+	int32_t					bend_f;				// 8192 = one octave
 	uint8_t					pan_l;
 	uint8_t					pan_r;
 
+private:					// smoothed state, 7.8 fixed point
+	uint16_t				volume_s;
+	uint16_t				pan_s;
+
+private:					// voices playing on this channel
+	uint8_t					voices = no_voice;
+	uint8_t					nvoices = 0;
+	bool					mono = false;		// set by channel mode messages
+
+private:					// the patch's modulation routes that have any effect
+	ModRoute				routes[MAX_MOD_ROUTES];
+	uint8_t					nroutes = 0;
+
+private:					// MPE zone membership
+	Channel*				master = nullptr;	// set on a zone's member channels
+	uint8_t					zone_members = 0;	// set on a zone's master channel
+
+private:					// voices released while held by a pedal
+	uint8_t					held = no_voice;
+
+private:					// most recent note, for glide and mono mode
+	uint8_t					last_note = 0xff;
+	uint8_t					last_voice = no_voice;
+
+private:					// shared LFO state
+	uint32_t				lfo_pos = 0;
+	int16_t					lfo = 0;			// 16 bits
+	int16_t					lfo_amount = 0;		// 14 bits, scaled by depth and wheel
+
 private:					// cached state
 	int16_t					bend_x = 0xffff;
 
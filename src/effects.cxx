@@ -0,0 +1,118 @@
+#include "effects.h"
+
+// the engine's buses carry 22-bit samples, which are scaled to 16 bits
+// for the delay lines and back again on output
+static const uint8_t bus_shift = 6;
+
+//--------------------------------------------------------------------+
+// Chorus
+//--------------------------------------------------------------------+
+
+static const uint32_t chorus_base = scaled(7 * 44100 / 1000) << 8;	// 7 ms
+static const uint32_t chorus_depth = scaled(2 * 44100 / 1000) << 8;	// 2 ms sweep
+
+Chorus::Chorus()
+	: lfo_step((uint32_t)((8ULL << 32) / (10 * SAMPLE_RATE)))		// 0.8 Hz
+{
+}
+
+// reads the line `delay` samples back, with linear interpolation
+inline int32_t Chorus::tap(uint32_t delay)
+{
+	uint16_t i = (pos - (delay >> 8)) & (size - 1);
+	uint16_t j = (i - 1) & (size - 1);
+	int32_t frac = delay & 0xff;
+	int32_t a = line[i];
+	int32_t b = line[j];
+	return a + (((b - a) * frac) >> 8);
+}
+
+// triangle wave, 15 bits unsigned
+static inline int32_t triangle(uint32_t phase)
+{
+	uint32_t t = phase >> 16;
+	return (t < 32768) ? t : 65535 - t;
+}
+
+void Chorus::process(int32_t* samples, const int32_t* in, size_t n)
+{
+	for (size_t i = 0, j = 0; i < n; ++i) {
+		line[pos] = in[i] >> bus_shift;
+
+		uint32_t dl = chorus_base + ((triangle(lfo_pos) * chorus_depth) >> 15) - chorus_depth / 2;
+		uint32_t dr = chorus_base + ((triangle(lfo_pos + 0x80000000) * chorus_depth) >> 15) - chorus_depth / 2;
+		lfo_pos += lfo_step;
+
+		samples[j++] += tap(dl) * (1 << bus_shift);
+		samples[j++] += tap(dr) * (1 << bus_shift);
+
+		pos = (pos + 1) & (size - 1);
+	}
+}
+
+void Chorus::clear()
+{
+	for (auto& s : line) s = 0;
+}
+
+//--------------------------------------------------------------------+
+// Reverb
+//--------------------------------------------------------------------+
+
+void Reverb::process(int32_t* samples, const int32_t* in, size_t n)
+{
+	for (size_t i = 0, j = 0; i < n; ++i) {
+
+		// the combs' gain is roughly 25x, so attenuate the input
+		int32_t x = in[i] >> (bus_shift + 5);
+
+		int32_t l = comb_l0.process(x, feedback, damp) +
+					comb_l1.process(x, feedback, damp) +
+					comb_l2.process(x, feedback, damp) +
+					comb_l3.process(x, feedback, damp);
+
+		int32_t r = comb_r0.process(x, feedback, damp) +
+					comb_r1.process(x, feedback, damp) +
+					comb_r2.process(x, feedback, damp) +
+					comb_r3.process(x, feedback, damp);
+
+		l = ap_l1.process(ap_l0.process(l));
+		r = ap_r1.process(ap_r0.process(r));
+
+		samples[j++] += l * (1 << (bus_shift - 1));
+		samples[j++] += r * (1 << (bus_shift - 1));
+	}
+}
+
+void Reverb::clear()
+{
+	comb_l0.clear();
+	comb_l1.clear();
+	comb_l2.clear();
+	comb_l3.clear();
+	comb_r0.clear();
+	comb_r1.clear();
+	comb_r2.clear();
+	comb_r3.clear();
+	ap_l0.clear();
+	ap_l1.clear();
+	ap_r0.clear();
+	ap_r1.clear();
+}
+
+//--------------------------------------------------------------------+
+// Effects stage
+//--------------------------------------------------------------------+
+
+void Effects::process(int32_t* samples, const int32_t* chorus_in,
+	const int32_t* reverb_in, size_t n)
+{
+	chorus.process(samples, chorus_in, n);
+	reverb.process(samples, reverb_in, n);
+}
+
+void Effects::clear()
+{
+	chorus.clear();
+	reverb.clear();
+}
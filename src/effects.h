@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "settings.h"
+
+// delay line lengths are tuned for 44.1kHz
+static constexpr uint16_t scaled(uint32_t n)
+{
+	return n * SAMPLE_RATE / 44100;
+}
+
+static inline int16_t clamp16(int32_t x)
+{
+	if (x > 32767) return 32767;
+	if (x < -32768) return -32768;
+	return x;
+}
+
+//--------------------------------------------------------------------+
+// Reverb building blocks, with 16-bit delay lines
+//--------------------------------------------------------------------+
+
+// feedback comb with a one-pole lowpass in the loop
+template <uint16_t size>
+class Comb {
+
+private:
+	int16_t				buf[size] = {};
+	uint16_t			pos = 0;
+	int32_t				store = 0;
+
+public:
+	inline int32_t process(int32_t in, int32_t feedback, int32_t damp)
+	{
+		int32_t out = buf[pos];
+		store = out + (((store - out) * damp) >> 15);
+		buf[pos] = clamp16(in + ((store * feedback) >> 15));
+		if (++pos == size) pos = 0;
+		return out;
+	}
+
+	inline void clear()
+	{
+		for (auto& b : buf) b = 0;
+		store = 0;
+	}
+
+};
+
+// Schroeder allpass with a fixed gain of 0.5
+template <uint16_t size>
+class Allpass {
+
+private:
+	int16_t				buf[size] = {};
+	uint16_t			pos = 0;
+
+public:
+	inline int32_t process(int32_t in)
+	{
+		int32_t b = buf[pos];
+		buf[pos] = clamp16(in + (b >> 1));
+		if (++pos == size) pos = 0;
+		return b - in;
+	}
+
+	inline void clear()
+	{
+		for (auto& b : buf) b = 0;
+	}
+
+};
+
+//--------------------------------------------------------------------+
+// Master effects
+//--------------------------------------------------------------------+
+
+// stereo chorus, from two taps swept in anti-phase along one delay line
+class Chorus {
+
+private:
+	static const uint16_t	size = 1024;		// power of two
+	int32_t					line[size] = {};
+	uint16_t				pos = 0;
+	uint32_t				lfo_pos = 0;
+	uint32_t				lfo_step;
+
+private:
+	inline int32_t			tap(uint32_t delay);	// delay in 1/256ths
+
+public:
+	void					process(int32_t* samples, const int32_t* in, size_t n);
+	void					clear();
+
+public:
+							Chorus();
+
+};
+
+// Freeverb style stereo reverb - four combs and two allpasses per side,
+// with the right side's lines slightly longer for decorrelation
+class Reverb {
+
+private:
+	static const uint16_t	spread = 23;
+
+	Comb<scaled(1116)>		comb_l0;
+	Comb<scaled(1188)>		comb_l1;
+	Comb<scaled(1277)>		comb_l2;
+	Comb<scaled(1356)>		comb_l3;
+	Comb<scaled(1116 + spread)>	comb_r0;
+	Comb<scaled(1188 + spread)>	comb_r1;
+	Comb<scaled(1277 + spread)>	comb_r2;
+	Comb<scaled(1356 + spread)>	comb_r3;
+	Allpass<scaled(556)>	ap_l0;
+	Allpass<scaled(441)>	ap_l1;
+	Allpass<scaled(556 + spread)>	ap_r0;
+	Allpass<scaled(441 + spread)>	ap_r1;
+
+	int32_t					feedback = 27525;	// 0.84, in 1.15
+	int32_t					damp = 6554;		// 0.2, in 1.15
+
+public:
+	void					process(int32_t* samples, const int32_t* in, size_t n);
+	void					clear();
+
+};
+
+// the effects stage run on core 0, adding the effects' outputs for the
+// engine's mono send buses to its (interleaved stereo) dry output
+class Effects {
+
+private:
+	Chorus					chorus;
+	Reverb					reverb;
+
+public:
+	void					process(int32_t* samples, const int32_t* chorus_in,
+								const int32_t* reverb_in, size_t n);
+
+	// silences the delay lines, e.g. once their tails have died away
+	void					clear();
+
+};
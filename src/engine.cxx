@@ -7,11 +7,9 @@
 #include "audio.h"
 #include "envelope.h"
 #include "midi.h"
+#include "tables.h"
 #include "waves.h"
 
-extern uint32_t note_table[];
-extern uint16_t power_table[];
-
 //--------------------------------------------------------------------+
 // Utility functions
 //--------------------------------------------------------------------+
@@ -31,6 +29,80 @@ static inline void frequency_modulate(uint32_t& step, int16_t x)
 	step = r1 + (r2 >> 16);
 }
 
+// as above, but for offsets spanning any number of octaves
+static inline void pitch_modulate(uint32_t& step, int32_t x)
+{
+	while (x >= 8192) {
+		step <<= 1;
+		x -= 8192;
+	}
+	while (x < -8192) {
+		step >>= 1;
+		x += 8192;
+	}
+	frequency_modulate(step, x);
+}
+
+// per-sample linear gain ramp (in 16.8 fixed point) from the level
+// used for the previous block to the level for this one, reached
+// after `n` samples, or straight away if `n` is zero
+struct GainRamp {
+	int32_t					g;
+	int32_t					d;
+	int32_t					to;
+
+	GainRamp(uint16_t from, uint16_t to, size_t n) :
+		g((n ? from : to) << 8),
+		d(n ? ((int32_t)to - from) * 256 / (int32_t)n : 0),
+		to(to << 8)
+	{
+	}
+
+	inline int32_t next() {
+		int32_t r = g >> 8;
+		g += d;
+		return r;
+	}
+
+	inline void hold() {
+		g = to;
+		d = 0;
+	}
+};
+
+// converts a pitch in 1/256ths of a semitone into a DCO step, using
+// the power table for the fraction (8192 / 12 per semitone)
+static inline uint32_t pitch_step(int32_t pitch)
+{
+	uint32_t step = note_table[pitch >> 8];
+	int16_t frac = pitch & 0xff;
+	if (frac) {
+		frequency_modulate(step, (frac * 683) >> 8);
+	}
+	return step;
+}
+
+// number of samples over which to ramp to the voice's new gain,
+// which is shorter than a block for very fast attacks
+static inline size_t ramp_length(const ADSR& env, size_t n)
+{
+	size_t k = env.ramp();
+	return (k < n) ? k : n;
+}
+
+// pops the next DCO sample from the interpolator, and if scanning a
+// wavetable crossfades it with the same offset in the following frame
+template <bool scan>
+static inline int32_t dco_sample(interp_hw_t* interp, int32_t frac)
+{
+	auto* t = (int16_t*)interp->pop[2];
+	if (scan) {
+		return t[0] + (((t[wave_len] - t[0]) * frac) >> 8);
+	} else {
+		return t[0];
+	}
+}
+
 //--------------------------------------------------------------------+
 // Per-voice state
 //--------------------------------------------------------------------+
@@ -39,31 +111,155 @@ void Voice::init()
 {
 	free = true;
 	steal = false;
-	channel = nullptr;
-	patch = nullptr;
-	dca_env = nullptr;
-	dco_env = nullptr;
+	patch = 0;
+	channel = no_channel;
+	member = no_channel;
+	pan_offset = 0;
 }
 
 Voice::Voice()
 {
 	init();
+
+	// free-running LFOs carry on across notes, but start from zero
+	lfo_pos = 0;
 }
 
+template <bool scan>
 void Voice::update(int16_t* samples, size_t n)
 {
+	auto& p = presets[patch];
+
 	// copy voice state to the interpolator
 	interp0->base[0] = dco_step;
-	interp0->base[2] = (uint32_t)waves[patch->dco_wave];
+	interp0->base[2] = (uintptr_t)dco_table;
 	interp0->accum[0] = dco_pos;
 
-	// generate the samples
-	for (uint i = 0; i < n; ++i) {
-		samples[i] = *(int16_t*)interp0->pop[2];
+	if (p.dco2_level) {
+
+		// DCO2 runs on the otherwise idle second interpolator
+		interp1->base[0] = dco2_step;
+		interp1->base[2] = (uintptr_t)waves[p.dco2_wave];
+		interp1->accum[0] = dco2_pos;
+
+		// 8-bit crossfade levels, summing to 256, with the level
+		// clamped so that DCO1's can't go negative
+		int32_t l2 = (p.dco2_level < 128 ? p.dco2_level : 128) << 1;
+		int32_t l1 = 256 - l2;
+
+		if (gliding) {
+
+			// ramp both steps per sample from the last block's values
+			int32_t d1 = (int32_t)(dco_step - dco_step_last) / (int32_t)n;
+			int32_t d2 = (int32_t)(dco2_step - dco2_step_last) / (int32_t)n;
+			uint32_t step1 = dco_step_last;
+			uint32_t step2 = dco2_step_last;
+
+			for (uint i = 0; i < n; ++i) {
+				interp0->base[0] = step1;
+				interp1->base[0] = step2;
+				step1 += d1;
+				step2 += d2;
+				int32_t s1 = dco_sample<scan>(interp0, wt_frac);
+				int32_t s2 = *(int16_t*)interp1->pop[2];
+				samples[i] = (s1 * l1 + s2 * l2) >> 8;
+			}
+
+		} else {
+
+			// generate and mix both DCOs in the same pass
+			for (uint i = 0; i < n; ++i) {
+				int32_t s1 = dco_sample<scan>(interp0, wt_frac);
+				int32_t s2 = *(int16_t*)interp1->pop[2];
+				samples[i] = (s1 * l1 + s2 * l2) >> 8;
+			}
+		}
+
+		dco2_pos = interp1->accum[0] & (wave_max - 1);
+
+	} else if (gliding) {
+
+		// ramp the step per sample from the last block's value
+		int32_t d1 = (int32_t)(dco_step - dco_step_last) / (int32_t)n;
+		uint32_t step1 = dco_step_last;
+
+		for (uint i = 0; i < n; ++i) {
+			interp0->base[0] = step1;
+			step1 += d1;
+			samples[i] = dco_sample<scan>(interp0, wt_frac);
+		}
+
+	} else {
+
+		// generate the samples
+		for (uint i = 0; i < n; ++i) {
+			samples[i] = dco_sample<scan>(interp0, wt_frac);
+		}
 	}
 
 	// update voice state
 	dco_pos = interp0->accum[0] & (wave_max - 1);
+	dco_step_last = dco_step;
+	dco2_step_last = dco2_step;
+}
+
+// renders the unison copies of DCO1 in pairs, one on each interpolator,
+// accumulating the lower-detuned copy of each pair into `a` and the
+// higher into `b` so that the two sides can be spread in the stereo mix
+template <bool scan>
+void Voice::update_unison(int32_t* a, int32_t* b, size_t n)
+{
+	interp0->base[2] = (uintptr_t)dco_table;
+	interp1->base[2] = (uintptr_t)dco_table;
+
+	uint8_t pairs = unison >> 1;
+	int16_t x = (1 - unison) * unison_x;		// lowest detune
+
+	for (uint8_t k = 0; k < pairs; ++k) {
+		uint8_t j = unison - 1 - k;
+
+		uint32_t step_lo = dco_step;
+		uint32_t step_hi = dco_step;
+		frequency_modulate(step_lo, x);
+		frequency_modulate(step_hi, -x);
+
+		interp0->base[0] = step_lo;
+		interp0->accum[0] = unison_pos[k];
+		interp1->base[0] = step_hi;
+		interp1->accum[0] = unison_pos[j];
+
+		// the first pair initialises the accumulators
+		if (k == 0) {
+			for (uint i = 0; i < n; ++i) {
+				a[i] = dco_sample<scan>(interp0, wt_frac);
+				b[i] = dco_sample<scan>(interp1, wt_frac);
+			}
+		} else {
+			for (uint i = 0; i < n; ++i) {
+				a[i] += dco_sample<scan>(interp0, wt_frac);
+				b[i] += dco_sample<scan>(interp1, wt_frac);
+			}
+		}
+
+		unison_pos[k] = interp0->accum[0] & (wave_max - 1);
+		unison_pos[j] = interp1->accum[0] & (wave_max - 1);
+
+		x += 2 * unison_x;
+	}
+
+	// an odd count leaves the undetuned centre copy, split across both sides
+	if (unison & 1) {
+		interp0->base[0] = dco_step;
+		interp0->accum[0] = unison_pos[pairs];
+
+		for (uint i = 0; i < n; ++i) {
+			int32_t s = dco_sample<scan>(interp0, wt_frac) >> 1;
+			a[i] += s;
+			b[i] += s;
+		}
+
+		unison_pos[pairs] = interp0->accum[0] & (wave_max - 1);
+	}
 }
 
 void Voice::note_on(uint8_t _chan, uint8_t _note, uint8_t _vel)
@@ -74,104 +270,284 @@ void Voice::note_on(uint8_t _chan, uint8_t _note, uint8_t _vel)
 	vel = _vel;
 
 	// load the current patch parameters
-	auto& p = *patch;
+	auto& p = presets[patch];
 
 	// set up the DCA envelope
-	dca_env = new ADSR(p.dca_env_a, p.dca_env_d, p.dca_env_s, p.dca_env_r);
-	dca_env->gate_on();
+	dca_env = ADSR(p.dca_env_a, p.dca_env_d, p.dca_env_s, p.dca_env_r);
+	dca_env.gate_on();
 
-	// set up the DCO envelope
+	// set up the DCO envelope, which stays at zero if unused
+	dco_env = ADSR(p.dco_env_a, p.dco_env_d, p.dco_env_s, p.dco_env_r);
 	if (p.dco_env_level) {
-		dco_env = new ADSR(p.dco_env_a, p.dco_env_d, p.dco_env_s, p.dco_env_r);
-		dco_env->gate_on();
+		dco_env.gate_on();
+	}
+
+	// new notes fade in from silence over their first block
+	for (auto& g : gain) {
+		g = 0;
 	}
 
 	// setup DCO
 	dco_step_base = note_table[note];
+	dco_step_last = dco_step_base;
 	dco_pos = 0;
+
+	// no glide unless the engine sets one up
+	gliding = false;
+	pitch = pitch_target = note << 8;
+	glide_step = 0;
+
+	// setup LFO
+	lfo_step = note_table[p.lfo_freq];
+	if (p.lfo_mode == LFO_KEY_SYNC) {
+		lfo_pos = 0;
+	}
+
+	// setup unison, with the detune between adjacent copies
+	// as a (14-bit signed) power table offset
+	unison = p.unison > max_unison ? max_unison : p.unison;
+	if (unison > 1) {
+		unison_x = p.unison_detune * 8192 / (2400 * (unison - 1));
+	}
+
+	// setup DCO2, with the detune as a (14-bit signed) power table offset
+	if (p.dco2_level) {
+		int32_t cents = p.dco2_coarse * 100 + p.dco2_fine;
+		int32_t x = cents * 8192 / 1200;
+		if (x < -8192) x = -8192;
+		if (x > 8191) x = 8191;
+		dco2_detune = x;
+		dco2_pos = 0;
+	}
 }
 
 void Voice::note_off()
 {
-	dca_env->gate_off();
+	dca_env.gate_off();
 
-	if (dco_env) {
-		dco_env->gate_off();
+	if (presets[patch].dco_env_level) {
+		dco_env.gate_off();
 	}
 
 	steal = true;		// voice may now be stolen
 }
 
+// sets a new target pitch, reached in `ms` milliseconds in the log
+// domain, or immediately if `ms` is zero
+void Voice::glide_to(uint8_t _note, uint16_t ms)
+{
+	note = _note;
+	pitch_target = _note << 8;
+
+	if (!ms) {
+		pitch = pitch_target;
+		dco_step_base = note_table[_note];
+		return;
+	}
+
+	// per-block step, using the same block rate scaling as the envelopes
+	int32_t diff = pitch_target - pitch;
+	if (diff < 0) diff = -diff;
+	uint32_t rate = ENV_RATE_SCALE / ms;				// 20 bits per glide
+	glide_step = (diff * (int32_t)(rate >> 8)) >> 12;
+	if (glide_step < 1) glide_step = 1;
+}
+
+// restarts the envelopes of a sounding voice from their current
+// levels, for a re-strike of a note that's being held by a pedal
+void Voice::retrigger(uint8_t _vel)
+{
+	vel = _vel;
+
+	dca_env.gate_on();
+
+	if (presets[patch].dco_env_level) {
+		dco_env.gate_on();
+	}
+
+	steal = false;
+}
+
 //--------------------------------------------------------------------+
 // Core synth engine
 //--------------------------------------------------------------------+
 
+static const VoiceLinks unlinked = {
+	no_voice, no_voice, false, false, no_voice, no_voice
+};
+
+// xorshift PRNG, used for oscillator start phases
+uint32_t SynthEngine::random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
 SynthEngine::SynthEngine()
 {
 	// all voices start out unused
-	for (auto& v : voice) {
-		v.init();
+	for (uint8_t i = 0; i < nv; ++i) {
+		voice[i].init();
+		links[i] = unlinked;
+	}
+
+	// set all parts to a default preset
+	for (uint8_t c = 0; c < nc; ++c) {
+		midi_in(0xc0 + (c & 0x0f), c, 0, c >> 4);
+	}
+}
+
+// the current value of a modulation source for the given voice, in
+// 8 bits, signed for the bipolar sources
+int32_t SynthEngine::mod_source(const Voice& v, uint8_t source, int32_t lfo)
+{
+	auto& chan = channel[v.channel];
+	auto& expr = (v.member != no_channel) ? channel[v.member] : chan;	// per-note controllers
+
+	if (source >= MOD_CC) {
+		return expr.controller(source - MOD_CC) << 1;
 	}
 
-	// set all channels to a default preset
-	for (uint8_t c = 0; c < 16; ++c) {
-		midi_in(0xc0 + c, c, 0);
+	switch (source) {
+		case MOD_VELOCITY:
+			return v.vel << 1;
+		case MOD_KEY:
+			return (v.note - 60) << 1;
+		case MOD_WHEEL:
+			return chan.controller(modwheel) << 1;
+		case MOD_PRESSURE:
+			return expr.pressure << 1;
+		case MOD_DCA_ENV:
+			return v.dca_env.level() >> 7;
+		case MOD_DCO_ENV:
+			return v.dco_env.level() >> 7;
+		case MOD_LFO:
+			return lfo >> 8;
 	}
+
+	return 0;
 }
 
-void SynthEngine::deallocate(Voice& v)
+void SynthEngine::deallocate(uint8_t i)
 {
-	delete v.dca_env;
-	delete v.dco_env;
+	auto& v = voice[i];
+
+	if (links[i].held) {
+		unhold(i);
+	}
+
+	if (v.channel != no_channel) {
+		auto& c = channel[v.channel];
+		if (c.last_voice == i) {
+			c.last_voice = no_voice;
+		}
+		unlink(i);
+	}
+
 	v.init();
+	links[i] = unlinked;
+	--nvoices;
 }
 
-Voice* SynthEngine::allocate()
+bool SynthEngine::playing(uint8_t chan, uint8_t note, uint8_t port) const
+{
+	uint8_t c = ((port & (MIDI_PORTS - 1)) << 4) | (chan & 0x0f);
+	for (auto& v : voice) {
+		if (!v.free && v.channel == c && v.note == note) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// the oldest of a channel's voices, or of its released voices -
+// voices are linked at the head of the list, so that's the last match
+uint8_t SynthEngine::oldest(const Channel& c, bool released) const
+{
+	uint8_t found = no_voice;
+	for (uint8_t i = c.voices; i != no_voice; i = links[i].chan_next) {
+		if (!released || voice[i].steal) {
+			found = i;
+		}
+	}
+	return found;
+}
+
+// finds a voice for a new note on the requesting channel, stealing
+// from whichever channel is using the most voices so that one busy
+// part can't starve the others
+uint8_t SynthEngine::allocate(Channel& requester)
 {
 	// look for a spare voice
-	for (auto& v: voice) {
+	for (uint8_t i = 0; i < nv; ++i) {
+		auto& v = voice[i];
 		if (v.free) {
 			v.free = false;
 			v.steal = false;
-			return &v;
+			++nvoices;
+			return i;
 		}
 	}
 
-	// none-found, we need to steal
-	for (auto& v: voice) {
-		if (v.steal) {
-			deallocate(v);
-			return &v;
+	// none-found, we need to steal - prefer the oldest released voice,
+	// taken from the largest channel that has one
+	Channel* largest = nullptr;
+	uint8_t victim = no_voice;
+	uint8_t victim_size = 0;
+	for (auto& c : channel) {
+		if (!largest || c.nvoices > largest->nvoices) {
+			largest = &c;
+		}
+		if (c.nvoices <= victim_size) continue;
+		uint8_t i = oldest(c, true);
+		if (i != no_voice) {
+			victim = i;
+			victim_size = c.nvoices;
 		}
 	}
 
-	return nullptr;
-}
+	// failing that, cut the oldest sounding note from the largest
+	// channel, or from the requester itself if it's as large
+	if (victim == no_voice && largest) {
+		auto& c = (requester.nvoices < largest->nvoices) ? *largest : requester;
+		victim = oldest(c, false);
+	}
 
-// temporary buffer of mono samples
-static int16_t mono[BUFFER_SIZE];
+	if (victim != no_voice) {
+		deallocate(victim);
+		voice[victim].free = false;
+		++nvoices;
+		return victim;
+	}
+
+	return no_voice;
+}
 
-uint32_t __not_in_flash_func(SynthEngine::update)(int32_t* samples, size_t n)
+uint32_t __not_in_flash_func(SynthEngine::update)(int32_t* samples, size_t n,
+	int32_t* chorus, int32_t* reverb)
 {
-	uint32_t data = 0;
+	uint32_t active = 0;
 
 	// update all envelopes and release any voice
 	// that now has an inactive DCA
-	for (auto& v: voice) {
+	for (uint8_t i = 0; i < nv; ++i) {
+		auto& v = voice[i];
 		if (v.free) continue;
 
-		v.dca_env->update();
-		if (!v.dca_env->active()) {
-			deallocate(v);
+		v.dca_env.update();
+		if (!v.dca_env.active()) {
+			deallocate(i);
 			continue;
 		}
 
 		// get a reference to the current note's patch
-		auto& p = *v.patch;
+		auto& p = presets[v.patch];
 
 		// update DCO envelope
-		if (p.dco_env_level && v.dco_env) {
-			v.dco_env->update();
+		if (p.dco_env_level) {
+			v.dco_env.update();
 		}
 	}
 
@@ -181,21 +557,37 @@ uint32_t __not_in_flash_func(SynthEngine::update)(int32_t* samples, size_t n)
 	interp_config_set_mask(&cfg, 1, wave_shift);
 	interp_config_set_add_raw(&cfg, true);
 	interp_set_config(interp0, 0, &cfg);
+	interp_set_config(interp1, 0, &cfg);
+
+	// advance the smoothed channel state and shared channel LFOs
+	for (auto& c : channel) {
+		c.update();
+
+		auto& p = presets[c.program % 4];
+		if (p.lfo_mode != LFO_SHARED) continue;
+
+		uint8_t wheel = c.controller(modwheel);
+		c.lfo_pos = (c.lfo_pos + note_table[p.lfo_freq]) & (WAVE_MAX - 1);
+		c.lfo = waves[p.lfo_wave][c.lfo_pos >> 16];		// 16 bits
+		c.lfo_amount = (c.lfo * p.lfo_depth * wheel) >> 16;	// 14 bits
+	}
 
 	for (auto& v : voice) {
 
 		// voice not in use
 		if (v.free) continue;
 
-		// get a reference to the channel parameters
-		assert(v.chan < 0x10);
-		auto& chan = *v.channel;
+		// get a reference to the channel parameters, and to
+		// the MPE member channel if the note came from one
+		assert(v.channel != no_channel);
+		auto& chan = channel[v.channel];
+		auto* member = (v.member != no_channel) ? &channel[v.member] : nullptr;
 
 		// and a reference to the current note's patch
-		auto& p = *v.patch;
+		auto& p = presets[v.patch];
 
 		// get the 15-bit DCA current envelope level
-		uint32_t dca = v.dca_env->level();		// 15 bits
+		uint32_t dca = v.dca_env.level();		// 15 bits
 
 		// scale the DCA by the patch's 7-bit DCA master level
 		dca *= p.dca_env_level;					// 22 bits
@@ -205,23 +597,41 @@ uint32_t __not_in_flash_func(SynthEngine::update)(int32_t* samples, size_t n)
 
 		// scale the DCA by the 7-bit channel volume
 		dca >>= 7;								// 22 bits
-		dca *= chan.control[volume];			// 29 bits
+		dca *= chan.volume_s >> 8;				// 29 bits
 		dca >>= 4;								// 25 bits
 
-		// apply 7-bit pan and scale back to 16 bits
-		uint16_t level_l = (dca * chan.pan_l) >> 16;
-		uint16_t level_r = (dca * chan.pan_r) >> 16;
+		// MPE notes swell from half to full level with their pressure
+		if (member) {
+			dca = (dca >> 8) * (128 + member->pressure);	// 25 bits
+		}
 
-		// scale the DCO step by the current pitchbend amount
+		// glide towards the target pitch in the log domain
+		v.gliding = (v.pitch != v.pitch_target);
+		if (v.gliding) {
+			if (v.pitch < v.pitch_target) {
+				v.pitch += v.glide_step;
+				if (v.pitch > v.pitch_target) v.pitch = v.pitch_target;
+			} else {
+				v.pitch -= v.glide_step;
+				if (v.pitch < v.pitch_target) v.pitch = v.pitch_target;
+			}
+			v.dco_step_base = pitch_step(v.pitch);
+		}
+
+		// scale the DCO step by the current pitchbend amount, adding
+		// any per-note bend from the voice's MPE member channel
 		v.dco_step = v.dco_step_base;
-		if (chan.bend) {
-			frequency_modulate(v.dco_step, chan.bend_f);
+		int32_t bend = chan.bend_f;
+		if (member) {
+			bend += member->bend_f;
+		}
+		if (bend) {
+			pitch_modulate(v.dco_step, bend);
 		}
-		data = chan.bend_f + 8192;
 
 		// apply the DCO envelope
-		if (v.dco_env && p.dco_env_level) {
-			int32_t env = v.dco_env->level();	// 16 bits
+		if (p.dco_env_level) {
+			int32_t env = v.dco_env.level();	// 16 bits
 			if (true || env) {
 				env = env * p.dco_env_level;	// 24 bits
 				env >>= 10;						// 14 bits
@@ -229,63 +639,600 @@ uint32_t __not_in_flash_func(SynthEngine::update)(int32_t* samples, size_t n)
 			}
 		}
 
-		// update and apply the LFO
-		uint8_t wheel = chan.control[modwheel];
-		v.lfo_step = note_table[p.lfo_freq];
-		v.lfo_pos = (v.lfo_pos + v.lfo_step) & (WAVE_MAX - 1);
-		if (wheel && p.lfo_depth) {
-			int16_t* lfo_wave = waves[p.lfo_wave];
-			int32_t lfo_amount = lfo_wave[v.lfo_pos >> 16];	// 16 bits
-			lfo_amount *= p.lfo_depth;						// 23 bits
-			lfo_amount *= wheel;							// 30 bits
-			lfo_amount >>= 16;								// 14 bits
+		// update and apply the LFO, either the voice's own
+		// or the one shared by all voices on the channel
+		uint8_t wheel = chan.controller(modwheel);
+		int32_t lfo, lfo_amount = 0;
+		if (p.lfo_mode == LFO_SHARED) {
+			lfo = chan.lfo;
+			lfo_amount = chan.lfo_amount;
+		} else {
+			const int16_t* lfo_wave = waves[p.lfo_wave];
+			v.lfo_pos = (v.lfo_pos + v.lfo_step) & (WAVE_MAX - 1);
+			lfo = lfo_wave[v.lfo_pos >> 16];				// 16 bits
+			if (wheel && p.lfo_depth) {
+				lfo_amount = lfo * p.lfo_depth;				// 23 bits
+				lfo_amount *= wheel;						// 30 bits
+				lfo_amount >>= 16;							// 14 bits
+			}
+		}
+
+		if (lfo_amount) {
 			frequency_modulate(v.dco_step, lfo_amount);
 		}
 
+		// apply the channel's compiled modulation routes
+		int32_t mod_pitch = 0, mod_amp = 0, mod_pan = 0, mod_wt = 0;
+		for (uint8_t i = 0; i < chan.nroutes; ++i) {
+			auto& r = chan.routes[i];
+			int32_t x = mod_source(v, r.source, lfo) * r.amount;	// 16 bits
+			switch (r.dest) {
+				case DEST_PITCH:
+					mod_pitch += x;
+					break;
+				case DEST_AMP:
+					mod_amp += x;
+					break;
+				case DEST_PAN:
+					mod_pan += x;
+					break;
+				case DEST_WT_POSITION:
+					mod_wt += x;
+					break;
+			}
+		}
+
+		if (mod_pitch) {
+			pitch_modulate(v.dco_step, mod_pitch >> 2);	// 14 bits
+		}
+
+		if (mod_amp) {
+			int32_t g = 256 + (mod_amp >> 7);			// 8 bits
+			if (g < 0) g = 0;
+			if (g > 256) g = 256;
+			dca = (dca >> 8) * g;
+		}
+
+		// per-voice pan around the channel's position, from the key
+		// follow and spread set at note on, the LFO and any routes
+		int16_t pan_pos = chan.pan_s >> 8;
+		int32_t pan_mod = v.pan_offset + (mod_pan >> 8);
+		if (p.pan_lfo) {
+			pan_mod += (lfo * p.pan_lfo) >> 16;
+		}
+		if (pan_mod) {
+			pan_pos += pan_mod;
+			if (pan_pos < 0) pan_pos = 0;
+			if (pan_pos > 127) pan_pos = 127;
+		}
+
+		// select DCO1's wave, or the pair of wavetable frames
+		// either side of the current wavetable position
+		if (p.wt_source) {
+			int32_t mod = 0;							// 8 bits
+			switch (p.wt_source) {
+				case WT_DCA_ENV:
+					mod = v.dca_env.level() >> 7;
+					break;
+				case WT_DCO_ENV:
+					mod = v.dco_env.level() >> 7;
+					break;
+				case WT_LFO:
+					mod = lfo >> 8;
+					break;
+				case WT_MODWHEEL:
+					mod = wheel << 1;
+					break;
+			}
+
+			int32_t pos = (p.wt_position << 8) + mod * p.wt_amount;	// 7.8 bits
+			pos += mod_wt;
+
+			// MPE timbre (CC74) offsets the position either way from 64
+			if (member) {
+				pos += (member->controller(brightness) - 64) << 8;
+			}
+			if (pos < 0) pos = 0;
+			if (pos > (127 << 8)) pos = 127 << 8;
+
+			// rescale to a frame number with an 8-bit fraction
+			pos = (pos * (wavetable_frames - 1) * 258) >> 15;
+			v.dco_table = wavetable.v + ((pos >> 8) << wave_shift);
+			v.wt_frac = pos & 0xff;
+		} else {
+			v.dco_table = waves[p.dco_wave];
+		}
+
+		// post-pan effect sends, at the channel's CC 93 / 91 levels
+		int32_t send_c = chorus ? chan.controller(chorus_send) : 0;
+		int32_t send_r = reverb ? chan.controller(reverb_send) : 0;
+		bool send = send_c | send_r;
+
+		// unison voices render all of their copies of DCO1 into two
+		// groups, each of which is then panned either side of the
+		// channel's pan position
+		if (v.unison > 1) {
+			if (p.wt_source) {
+				v.update_unison<true>(unison_a, unison_b, n);
+			} else {
+				v.update_unison<false>(unison_a, unison_b, n);
+			}
+			++active;
+
+			// scale down by the number of copies on each side, rounded
+			// up to a power of two, so that their sum times the gain
+			// can't overflow for any MAX_UNISON
+			uint8_t side = (v.unison + 1) >> 1;
+			uint8_t shift = 0;
+			while ((1 << shift) < side) ++shift;
+			dca >>= shift;
+
+			int16_t centre = pan_pos;
+			int16_t half = p.unison_spread >> 1;
+			int16_t pan_a = (centre - half < 0) ? 0 : centre - half;
+			int16_t pan_b = (centre + half > 127) ? 127 : centre + half;
+
+			uint16_t level[4] = {
+				(uint16_t)((dca * pan_table[127 - pan_a]) >> 16),
+				(uint16_t)((dca * pan_table[pan_a]) >> 16),
+				(uint16_t)((dca * pan_table[127 - pan_b]) >> 16),
+				(uint16_t)((dca * pan_table[pan_b]) >> 16),
+			};
+
+			// don't bother accumulating silent voices
+			if (!dca && !(v.gain[0] | v.gain[1] | v.gain[2] | v.gain[3])) continue;
+
+			size_t k = ramp_length(v.dca_env, n);
+			GainRamp la(v.gain[0], level[0], k);
+			GainRamp ra(v.gain[1], level[1], k);
+			GainRamp lb(v.gain[2], level[2], k);
+			GainRamp rb(v.gain[3], level[3], k);
+
+			// ramp over the first `k` samples, then hold
+			for (size_t i = 0, j = 0, end = k; i < n; end = n) {
+				for (; i < end; ++i) {
+					int32_t sa = unison_a[i];
+					int32_t sb = unison_b[i];
+					int32_t l = ((la.next() * sa) >> 16) + ((lb.next() * sb) >> 16);
+					int32_t r = ((ra.next() * sa) >> 16) + ((rb.next() * sb) >> 16);
+					samples[j++] += l;
+					samples[j++] += r;
+					if (send) {
+						chorus[i] += ((l + r) * send_c) >> 8;
+						reverb[i] += ((l + r) * send_r) >> 8;
+					}
+				}
+				la.hold(); ra.hold(); lb.hold(); rb.hold();
+			}
+
+			for (uint8_t i = 0; i < 4; ++i) {
+				v.gain[i] = level[i];
+			}
+
+			continue;
+		}
+
+		// apply 7-bit pan and scale back to 16 bits
+		uint8_t pan_l = pan_mod ? pan_table[127 - pan_pos] : chan.pan_l;
+		uint8_t pan_r = pan_mod ? pan_table[pan_pos] : chan.pan_r;
+		uint16_t level_l = (dca * pan_l) >> 16;
+		uint16_t level_r = (dca * pan_r) >> 16;
+
+		// DCO2 tracks DCO1, offset by its detune
+		if (p.dco2_level) {
+			v.dco2_step = v.dco_step;
+			frequency_modulate(v.dco2_step, v.dco2_detune);
+		}
+
 		// generate a buffer full of (mono) samples
-		v.update(mono, n);
+		if (p.wt_source) {
+			v.update<true>(mono, n);
+		} else {
+			v.update<false>(mono, n);
+		}
+		++active;
 
 		// TODO: apply filters here
 
-		// don't bother accumulating silent channels
-		if (!dca) continue;
+		// don't bother accumulating silent voices
+		if (!dca && !(v.gain[0] | v.gain[1])) continue;
+
+		// accumulate the samples into the supplied output buffer,
+		// ramping the gain from the previous block's level over the
+		// first `k` samples, then holding it
+		size_t k = ramp_length(v.dca_env, n);
+		GainRamp gl(v.gain[0], level_l, k);
+		GainRamp gr(v.gain[1], level_r, k);
+
+		for (size_t i = 0, j = 0, end = k; i < n; end = n) {
+			for (; i < end; ++i) {
+				int32_t s = mono[i];
+				int32_t l = (gl.next() * s) >> 16;
+				int32_t r = (gr.next() * s) >> 16;
+				samples[j++] += l;
+				samples[j++] += r;
+				if (send) {
+					chorus[i] += ((l + r) * send_c) >> 8;
+					reverb[i] += ((l + r) * send_r) >> 8;
+				}
+			}
+			gl.hold();
+			gr.hold();
+		}
+
+		v.gain[0] = level_l;
+		v.gain[1] = level_r;
+	}
+
+	return active;
+}
+
+//--------------------------------------------------------------------+
+// Per-channel voice lists
+//--------------------------------------------------------------------+
+
+// each channel keeps a list of its voices so that per-channel
+// operations only touch the voices playing on that channel
+void SynthEngine::link(uint8_t i)
+{
+	auto& l = links[i];
+	auto& c = channel[voice[i].channel];
+
+	l.chan_prev = no_voice;
+	l.chan_next = c.voices;
+	if (c.voices != no_voice) {
+		links[c.voices].chan_prev = i;
+	}
+	c.voices = i;
+	++c.nvoices;
+}
+
+void SynthEngine::unlink(uint8_t i)
+{
+	auto& l = links[i];
+	auto& c = channel[voice[i].channel];
+
+	if (l.chan_prev != no_voice) {
+		links[l.chan_prev].chan_next = l.chan_next;
+	} else {
+		c.voices = l.chan_next;
+	}
+	if (l.chan_next != no_voice) {
+		links[l.chan_next].chan_prev = l.chan_prev;
+	}
+
+	l.chan_prev = no_voice;
+	l.chan_next = no_voice;
+	--c.nvoices;
+}
+
+//--------------------------------------------------------------------+
+// Sustain and sostenuto pedals
+//--------------------------------------------------------------------+
+
+// adds a voice whose key has been released to its channel's list of
+// pedal-held voices, so that they can be found without a full scan
+void SynthEngine::hold(uint8_t i)
+{
+	auto& l = links[i];
+	auto& c = channel[voice[i].channel];
+
+	l.held = true;
+	voice[i].steal = true;
+	l.held_prev = no_voice;
+	l.held_next = c.held;
+	if (c.held != no_voice) {
+		links[c.held].held_prev = i;
+	}
+	c.held = i;
+}
+
+void SynthEngine::unhold(uint8_t i)
+{
+	auto& l = links[i];
+	auto& c = channel[voice[i].channel];
+
+	if (l.held_prev != no_voice) {
+		links[l.held_prev].held_next = l.held_next;
+	} else {
+		c.held = l.held_next;
+	}
+	if (l.held_next != no_voice) {
+		links[l.held_next].held_prev = l.held_prev;
+	}
+
+	l.held = false;
+	l.held_prev = no_voice;
+	l.held_next = no_voice;
+}
+
+// releases every held voice that no pedal is still holding
+void SynthEngine::release_held(Channel& c)
+{
+	bool sustained = c.controller(sustain) >= 64;
+	bool sostenuto_down = c.controller(sostenuto) >= 64;
 
-		// accumulate the samples into the supplied output buffer
-		for (size_t i = 0, j = 0; i < n; ++i) {
-			samples[j++] += (level_l * mono[i]) >> 16;
-			samples[j++] += (level_r * mono[i]) >> 16;
+	uint8_t i = c.held;
+	while (i != no_voice) {
+		uint8_t next = links[i].held_next;
+
+		if (!sustained && !(links[i].sostenuto && sostenuto_down)) {
+			unhold(i);
+			voice[i].note_off();
 		}
+
+		i = next;
 	}
+}
 
-	return data;
+uint8_t SynthEngine::find_held(Channel& c, uint8_t note)
+{
+	for (uint8_t i = c.held; i != no_voice; i = links[i].held_next) {
+		if (voice[i].note == note) {
+			return i;
+		}
+	}
+	return no_voice;
+}
+
+void SynthEngine::control_change(uint8_t chan, uint8_t cc, uint8_t value)
+{
+	if (cc >= all_sound_off) {
+		channel_mode(chan, cc, value);
+		return;
+	}
+
+	auto& c = channel[chan];
+	bool was_down = c.controller(cc) >= 64;
+	bool is_down = value >= 64;
+
+	c.set_cc(cc, value);
+
+	if (cc == data_entry_msb && c.rpn == rpn_mpe_config) {
+		configure_zone(chan, value);
+	} else if (cc == sustain && was_down && !is_down) {
+		release_held(c);
+	} else if (cc == sostenuto && !was_down && is_down) {
+		// capture the notes whose keys are down right now
+		for (uint8_t i = c.voices; i != no_voice; i = links[i].chan_next) {
+			links[i].sostenuto = !voice[i].steal;
+		}
+	} else if (cc == sostenuto && was_down && !is_down) {
+		release_held(c);
+	}
+}
+
+//--------------------------------------------------------------------+
+// Channel mode messages
+//--------------------------------------------------------------------+
+
+// releases every key on the channel, leaving the pedals to hold
+// whichever notes they would otherwise hold
+void SynthEngine::notes_off(Channel& c)
+{
+	bool sustained = c.controller(sustain) >= 64;
+	bool sostenuto_down = c.controller(sostenuto) >= 64;
+
+	for (uint8_t i = c.voices; i != no_voice; i = links[i].chan_next) {
+		auto& v = voice[i];
+		if (v.steal) continue;
+		if (sustained || (links[i].sostenuto && sostenuto_down)) {
+			hold(i);
+		} else {
+			v.note_off();
+		}
+	}
+}
+
+// silences the channel immediately
+void SynthEngine::sound_off(Channel& c)
+{
+	uint8_t i = c.voices;
+	while (i != no_voice) {
+		uint8_t next = links[i].chan_next;
+		deallocate(i);
+		i = next;
+	}
+}
+
+// handles an MPE configuration message, received on a zone's master
+// channel - the first channel of a port for the lower zone and the last
+// for the upper zone - with member channels counting inwards from it
+void SynthEngine::configure_zone(uint8_t chan, uint8_t members)
+{
+	uint8_t port = chan & 0x10;
+	uint8_t index = chan & 0x0f;
+	if (index != 0 && index != 15) return;
+	if (members > 15) members = 15;
+
+	auto disband = [this](Channel& z) {
+		for (auto& c : channel) {
+			if (c.master == &z) {
+				c.master = nullptr;
+				c.set_bend_range(2);
+			}
+		}
+		z.zone_members = 0;
+	};
+
+	auto& m = channel[chan];
+	notes_off(m);
+	disband(m);
+
+	// this channel may have been a member of the other zone
+	if (m.master) {
+		--m.master->zone_members;
+		m.master = nullptr;
+	}
+
+	// take the member channels, shrinking the other zone if they overlap
+	for (uint8_t i = 1; i <= members; ++i) {
+		auto& c = channel[port | (index ? 15 - i : i)];
+		if (c.zone_members) {
+			notes_off(c);
+			disband(c);
+		}
+		if (c.master) {
+			notes_off(*c.master);
+			--c.master->zone_members;
+		}
+		c.master = &m;
+		c.set_bend_range(48);
+	}
+
+	m.zone_members = members;
+	m.set_bend_range(2);
+}
+
+void SynthEngine::channel_mode(uint8_t chan, uint8_t cc, uint8_t value)
+{
+	auto& c = channel[chan];
+
+	switch (cc) {
+		case all_sound_off:
+			sound_off(c);
+			break;
+		case reset_all:
+			c.reset_controllers();
+			release_held(c);
+			break;
+		case all_notes_off:
+		case omni_off:
+		case omni_on:
+			notes_off(c);
+			break;
+		case mono_on:
+			notes_off(c);
+			c.mono = true;
+			break;
+		case poly_on:
+			notes_off(c);
+			c.mono = false;
+			break;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Note handling
+//--------------------------------------------------------------------+
+
+// mono patches retarget the channel's current voice - legato if its key
+// is still down, otherwise restarting its envelopes
+bool SynthEngine::note_on_mono(Channel& c, uint8_t note, uint8_t vel)
+{
+	uint8_t i = c.last_voice;
+	if (i == no_voice) return false;
+
+	auto& v = voice[i];
+	auto& p = presets[v.patch];
+
+	if (links[i].held) {
+		unhold(i);
+	}
+
+	if (v.steal) {
+		v.retrigger(vel);
+	}
+
+	bool glide = p.glide_time && c.controller(portamento) >= 64;
+	v.glide_to(note, glide ? p.glide_time : 0);
+
+	return true;
 }
 
 void SynthEngine::note_on(uint8_t chan, uint8_t note, uint8_t vel)
 {
-	auto* vp = allocate();
-	if (vp) {
-		auto& v = *vp;
-		v.channel = &channel[chan];
-		v.patch = &presets[v.channel->program % 4];
+	// notes on an MPE member channel play on the zone's master channel,
+	// taking only their per-note expression from the member channel
+	auto& m = channel[chan];
+	auto& c = m.master ? *m.master : m;
+	uint8_t member = m.master ? chan : no_channel;
+	uint8_t patch = c.program % 4;
+	auto& p = presets[patch];
+	bool glide = p.glide_time && c.controller(portamento) >= 64;
+	uint8_t last_note = c.last_note;
+	c.last_note = note;
+
+	if ((p.mono || c.mono) && note_on_mono(c, note, vel)) {
+		voice[c.last_voice].member = member;
+		return;
+	}
+
+	// re-striking a note that's held by a pedal reuses its voice
+	if (c.held != no_voice) {
+		uint8_t h = find_held(c, note);
+		if (h != no_voice) {
+			unhold(h);
+			voice[h].retrigger(vel);
+			voice[h].member = member;
+			return;
+		}
+	}
+
+	uint8_t i = allocate(c);
+	if (i != no_voice) {
+		auto& v = voice[i];
+		v.channel = &c - channel;
+		v.member = member;
+		v.patch = patch;
 		v.note_on(chan, note, vel);
+		link(i);
+
+		// free-running unison copies start at random phases
+		for (uint8_t i = 0; i < v.unison; ++i) {
+			v.unison_pos[i] = random() & (wave_max - 1);
+		}
+
+		// fix the voice's place in the stereo field
+		int32_t pan_offset = ((note - 60) * p.pan_key) >> 4;
+		if (p.pan_spread) {
+			pan_offset += ((int32_t)(random() & 0xff) - 128) * p.pan_spread >> 8;
+		}
+		if (pan_offset < -127) pan_offset = -127;
+		if (pan_offset > 127) pan_offset = 127;
+		v.pan_offset = pan_offset;
+
+		// poly glide starts from the channel's previous note
+		if (glide && last_note != 0xff) {
+			v.pitch = last_note << 8;
+			v.glide_to(note, p.glide_time);
+			v.dco_step_base = pitch_step(v.pitch);
+			v.dco_step_last = v.dco_step_base;
+			if (p.dco2_level) {
+				v.dco2_step_last = v.dco_step_base;
+				frequency_modulate(v.dco2_step_last, v.dco2_detune);
+			}
+		}
+
+		c.last_voice = i;
 	}
 }
 
 void SynthEngine::note_off(uint8_t chan, uint8_t note, uint8_t vel)
 {
-	Channel* c = &channel[chan];
-	for (auto& v: voice) {
-		if (v.free) continue;
-		if (v.channel == c && v.note == note) {
-			v.note_off();
+	auto& m = channel[chan];
+	auto& c = m.master ? *m.master : m;
+	uint8_t member = m.master ? chan : no_channel;
+	bool sustained = c.controller(sustain) >= 64;
+	bool sostenuto_down = c.controller(sostenuto) >= 64;
+
+	for (uint8_t i = c.voices; i != no_voice; i = links[i].chan_next) {
+		auto& v = voice[i];
+		if (v.steal) continue;					// key already up
+		if (v.note == note && v.member == member) {
+			if (sustained || (links[i].sostenuto && sostenuto_down)) {
+				hold(i);
+			} else {
+				v.note_off();
+			}
 		}
 	}
 }
 
-void SynthEngine::midi_in(uint8_t c, uint8_t d1, uint8_t d2)
+void SynthEngine::midi_in(uint8_t c, uint8_t d1, uint8_t d2, uint8_t port)
 {
 	uint8_t cmd = (c & 0xf0) >> 4;
-	uint8_t chan = (c & 0x0f);
+	uint8_t chan = ((port & (MIDI_PORTS - 1)) << 4) | (c & 0x0f);		// part number
 
 	switch (cmd) {
 		case 0x8:
@@ -299,6 +1246,8 @@ void SynthEngine::midi_in(uint8_t c, uint8_t d1, uint8_t d2)
 			}
 			break;
 		case 0xb:
+			control_change(chan, d1, d2);
+			break;
 		case 0xc:
 		case 0xd:
 		case 0xe:
@@ -4,63 +4,154 @@
 #include <cstddef>
 
 #include "channel.h"
+#include "envelope.h"
 #include "patch.h"
+#include "settings.h"
 #include "waves.h"
 
-class Envelope;
+static const uint8_t		no_channel = 0xff;
 
+// the state a voice renders from, read and written every block - the
+// bookkeeping used only by note and pedal handling is kept apart in
+// VoiceLinks, and channels, patches and other voices are referred to
+// by index
 class Voice {
 
 	friend class			SynthEngine;
 
 private:
 	bool					free;
-	bool					steal;
+	bool					steal;			// key is up, so the voice may be stolen
 	uint8_t					note;
 	uint8_t					vel;
 
+	uint8_t					patch;			// preset number
+	uint8_t					channel;
+	uint8_t					member;			// MPE member channel, or no_channel
+	uint8_t					unison;			// DCO1 copies
+
 	uint32_t				dco_step_base;
 	uint32_t				dco_step;
+	uint32_t				dco_step_last;	// step at the end of the last block
 	uint32_t				dco_pos;
 
+	// portamento, with pitches in 1/256ths of a semitone
+	bool					gliding;
+	int32_t					pitch;
+	int32_t					pitch_target;
+	int32_t					glide_step;
+
+	const int16_t*			dco_table;		// DCO1 wave or wavetable frame
+	int16_t					wt_frac;		// crossfade into the next frame
+
+	int16_t					dco2_detune;
+	uint32_t				dco2_step;
+	uint32_t				dco2_step_last;
+	uint32_t				dco2_pos;
+
 	uint32_t				lfo_step;
 	uint32_t				lfo_pos;
 
-	Channel*				channel;
-	Patch*					patch;
-	Envelope*				dca_env;
-	Envelope*				dco_env;
+	int8_t					pan_offset;		// key follow and spread, from note on
+	uint16_t				gain[4];		// output levels used in the last block
+
+	ADSR					dca_env;
+	ADSR					dco_env;		// only gated if the patch uses it
+
+	// unison mode, which uses both interpolators (and so excludes DCO2),
+	// last as most voices don't use it
+	static const uint8_t	max_unison = MAX_UNISON;
+	int16_t					unison_x;
+	uint32_t				unison_pos[max_unison];
 
 private:
 	void					init();
+	template <bool scan>
 	void					update(int16_t* samples, size_t n);
+	template <bool scan>
+	void					update_unison(int32_t* a, int32_t* b, size_t n);
 	void					note_on(uint8_t chan, uint8_t note, uint8_t vel);
 	void					note_off();
+	void					retrigger(uint8_t vel);
+	void					glide_to(uint8_t note, uint16_t ms);
 
 public:
 							Voice();
 
 };
 
+// a voice's place in its channel's lists of voices and of pedal-held
+// voices, as voice numbers
+struct VoiceLinks {
+	uint8_t					chan_prev;
+	uint8_t					chan_next;
+
+	// sustain / sostenuto pedal state
+	bool					held;			// released, but held by a pedal
+	bool					sostenuto;		// key was down when sostenuto pressed
+	uint8_t					held_prev;
+	uint8_t					held_next;
+};
+
 class SynthEngine {
 
 private:
-	static const uint8_t	nv = 128;
+	static_assert(MAX_VOICES > 0 && MAX_VOICES < 256, "MAX_VOICES must be 1 - 255");
+	static_assert(MIDI_PORTS == 1 || MIDI_PORTS == 2, "MIDI_PORTS must be 1 or 2");
+	static_assert(MAX_UNISON > 0 && MAX_UNISON < 256, "MAX_UNISON must be 1 - 255");
+
+	static const uint8_t	nv = MAX_VOICES;
+	static const uint8_t	nc = 16 * MIDI_PORTS;
 	Voice					voice[nv];
-	Channel					channel[16];
+	VoiceLinks				links[nv];
+	Channel					channel[nc];
+	uint8_t					nvoices = 0;		// voices in use
+	uint32_t				seed = 1;
+
+private:					// scratch buffers for rendering
+	int16_t					mono[BUFFER_SIZE];					// one voice
+	int32_t					unison_a[BUFFER_SIZE];				// the two sides
+	int32_t					unison_b[BUFFER_SIZE];				// of a unison voice
 
 private:
-	Voice*					allocate();
-	void					deallocate(Voice& v);
+	uint32_t				random();
+	uint8_t					allocate(Channel& c);
+	uint8_t					oldest(const Channel& c, bool released) const;
+	int32_t					mod_source(const Voice& v, uint8_t source, int32_t lfo);
+	void					deallocate(uint8_t i);
 
 	void					note_on(uint8_t chan, uint8_t note, uint8_t vel);
 	void					note_off(uint8_t chan, uint8_t note, uint8_t vel);
+	void					control_change(uint8_t chan, uint8_t cc, uint8_t value);
+
+	void					channel_mode(uint8_t chan, uint8_t cc, uint8_t value);
+	void					notes_off(Channel& c);
+	void					sound_off(Channel& c);
+	void					configure_zone(uint8_t chan, uint8_t members);
+
+	void					link(uint8_t i);
+	void					unlink(uint8_t i);
+	void					hold(uint8_t i);
+	void					unhold(uint8_t i);
+	void					release_held(Channel& c);
+	uint8_t					find_held(Channel& c, uint8_t note);
+	bool					note_on_mono(Channel& c, uint8_t note, uint8_t vel);
 
 public:
-	void					midi_in(uint8_t c, uint8_t d1, uint8_t d2);
+	void					midi_in(uint8_t c, uint8_t d1, uint8_t d2, uint8_t port = 0);
+
+	// true when no voices are in use, so that update() would only
+	// render silence
+	bool					idle() const { return nvoices == 0; }
+
+	// true when a voice is in use for the note on the given channel
+	bool					playing(uint8_t chan, uint8_t note, uint8_t port = 0) const;
 
 public:
-	uint32_t				update(int32_t* samples, size_t n);
+	// renders interleaved stereo into `samples`, and optionally into the
+	// mono chorus and reverb send buses - returns voices rendered
+	uint32_t				update(int32_t* samples, size_t n,
+								int32_t* chorus = nullptr, int32_t* reverb = nullptr);
 
 public:
 							SynthEngine();
@@ -1,10 +1,12 @@
 #include "envelope.h"
+#include "settings.h"
+#include "tables.h"
 
 //--------------------------------------------------------------------+
 // Generic Envelope with 16 bits of resolution
 //--------------------------------------------------------------------+
 Envelope::Envelope()
-	: _level(0)
+	: _level(0), _ramp(BUFFER_SIZE)
 {
 }
 
@@ -12,40 +14,73 @@ Envelope::Envelope()
 // Standard four phase ADSR Envelope
 //--------------------------------------------------------------------+
 
-ADSR::ADSR(uint8_t a, uint8_t d, uint8_t s, uint8_t r)
-	: s(s << 8), a(a), d(d), r(r), phase(off)
+// each segment runs its 20-bit position from zero to `full`, once per
+// block, with the level following an exponential curve table
+static const uint32_t full = 0x100000;
+static const uint8_t curve_shift = 12;
+
+// converts a segment time in milliseconds into a per-block step
+static inline uint32_t rate(uint16_t ms)
+{
+	return ms ? ENV_RATE_SCALE / ms : full;
+}
+
+ADSR::ADSR(uint16_t a_ms, uint16_t d_ms, uint8_t s, uint16_t r_ms)
+	: a(rate(a_ms)), d(rate(d_ms)), r(rate(r_ms)), s(s << 8),
+	  a_ramp(BUFFER_SIZE), start(0), pos(0), phase(off)
 {
-	if (a < 1) a = 1;
-	if (d < 1) d = 1;
-	if (r < 1) r = 1;
+	// attacks shorter than a block are applied per-sample by
+	// ramping the DCA over just the attack's length, and with no
+	// attack at all the DCA starts the block at full level
+	if (!a_ms) {
+		a_ramp = 0;
+	} else if (a > full) {
+		a_ramp = (BUFFER_SIZE << 8) / (a >> 12);
+		if (a_ramp < 1) a_ramp = 1;
+	}
 }
 
 int16_t ADSR::update()
 {
 	auto& v = _level;
+	_ramp = BUFFER_SIZE;
 
 	switch (phase) {
 		case attack: {
-			v += (a << 7);
-			if (v >= 0x7fff) {
+			if (pos == 0) {
+				_ramp = a_ramp;
+			}
+			pos += a;
+			if (pos >= full) {
 				v = 0x7fff;
+				pos = 0;
 				phase = decay;
+			} else {
+				// rising curve, the inverse of the decay shape
+				int32_t c = 0xffff - env_curve_table[pos >> curve_shift];
+				v = start + (((0x7fff - start) * c) >> 16);
 			}
 			break;
 		}
 		case decay: {
-			v -= (d << 5);
-			if (v <= s) {
+			pos += d;
+			if (pos >= full) {
 				v = s;
 				phase = v ? sustain : off;	// ADSR with no sustain
+			} else {
+				int32_t c = env_curve_table[pos >> curve_shift];
+				v = s + (((0x7fff - s) * c) >> 16);
 			}
 			break;
 		}
 		case release: {
-			v -= (r << 4);
-			if (v <= 0) {
+			pos += r;
+			if (pos >= full) {
 				v = 0;
 				phase = off;
+			} else {
+				int32_t c = env_curve_table[pos >> curve_shift];
+				v = (start * c) >> 16;
 			}
 			break;
 		}
@@ -58,10 +93,14 @@ int16_t ADSR::update()
 
 void ADSR::gate_on()
 {
+	start = _level;
+	pos = 0;
 	phase = attack;
 }
 
 void ADSR::gate_off()
 {
+	start = _level;
+	pos = 0;
 	phase = release;
 }
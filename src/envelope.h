@@ -2,31 +2,35 @@
 
 #include <cstdint>
 
+// the level and ramp shared by envelope types, which are used by value
+// and never through the base class, so there are no virtual calls
 class Envelope {
 
 protected:
 	int32_t				_level;
+	uint16_t			_ramp;
 
 public:
-	virtual void		gate_on() = 0;
-	virtual void		gate_off() = 0;
+	int16_t				level() const { return _level; }
 
-public:
-	virtual bool		active() = 0;
-	virtual int16_t		update() = 0;
-	virtual int16_t		level() { return _level; }
+	// number of samples into the current block by which the new
+	// level is reached (normally the whole block)
+	uint16_t			ramp() const { return _ramp; }
 
-public:
+protected:
 						Envelope();
-	virtual				~Envelope() = default;
 
 };
 
-class ADSR : virtual public Envelope {
+class ADSR final : public Envelope {
 
 private:
+	uint32_t		a, d, r;		// segment rates
 	uint16_t		s;
-	uint8_t			a, d, r;
+	uint16_t		a_ramp;			// attack length in samples, if < 1 block
+
+	int32_t			start;			// level at the start of the segment
+	uint32_t		pos;			// 20-bit position within the segment
 
 					enum Phase {
 						off,
@@ -41,10 +45,11 @@ public:
 	void			gate_off();
 
 public:
-	bool			active() { return phase > off; };
+	bool			active() const { return phase > off; }
 	int16_t			update();
 
 public:
-					ADSR(uint8_t a, uint8_t d, uint8_t s, uint8_t r);
+					ADSR() : ADSR(0, 0, 0, 0) {}
+					ADSR(uint16_t a_ms, uint16_t d_ms, uint8_t s, uint16_t r_ms);
 
 };
@@ -1,6 +1,4 @@
 #include <string>
-#include <sstream>
-#include <iomanip>
 
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
@@ -24,19 +22,31 @@
 #endif
 
 #include "bench.h"
+#include "bench_sweep.h"
 #include "audio.h"
 #include "engine.h"
+#include "effects.h"
+#include "midi_flood.h"
+#include "midi_parser.h"
+#include "midi_queue.h"
 
-SynthEngine engine;
+static SynthEngine engine;
 static audio_buffer_pool *ap = nullptr;
 
-static queue_t midi_queue;
+static MidiQueue midi_queue;
+
+#if CONFIG_MIDI_FLOOD
+static MidiFlood flood;
+#endif
 
 static queue_t bench_queue;
 
+// set by incoming MIDI, to bring the clock back up from idle
+static volatile bool wake = false;
+
 struct bench_entry {
 	uint32_t	delta;
-	uint32_t	data;
+	uint32_t	voices;
 };
 
 //--------------------------------------------------------------------+
@@ -75,14 +85,26 @@ void led_blinking_task(void)
 // MIDI packet dispatch
 //--------------------------------------------------------------------+
 
-static void process_packet(uint8_t *packet)
+// core 0 never waits for the queue to drain, as core 1 only drains it
+// once core 0 has passed back a block - a full queue is returned so
+// that the caller can hold the packet back or drop it
+static MidiQueue::Result process_packet(const uint8_t *packet)
 {
-	led_toggle();
+	// each configured cable addresses a bank of 16 parts
+	uint8_t cable = packet[0] >> 4;
+	if (cable >= MIDI_PORTS) return MidiQueue::dropped;
 
-	uint8_t cable = packet[0] & 0xf0;
-	if (cable != 0) return;
+	auto result = midi_queue.try_push(packet);
+	if (result == MidiQueue::full) return result;
 
-	queue_add_blocking(&midi_queue, packet);
+	led_toggle();
+
+	// only messages for the engine end the idle period, so that a
+	// host's MIDI clock or active sensing doesn't keep the clock up
+	if (result == MidiQueue::queued) {
+		wake = true;
+	}
+	return result;
 }
 
 //--------------------------------------------------------------------+
@@ -121,14 +143,16 @@ void tud_resume_cb(void)
 // USB MIDI RX task
 //--------------------------------------------------------------------+
 
-void tud_midi_rx_cb(uint8_t itf)
+// reads packets until the queue is full, keeping the one that didn't
+// fit for the next call - meanwhile USB holds off the host
+void usb_midi_task()
 {
-	uint8_t packet[4];
+	static uint8_t packet[4];
+	static bool held = false;
 
-	while (tud_midi_n_available(itf, 0) >= 4) {
-		if (tud_midi_n_packet_read(itf, packet)) {
-			process_packet(packet);
-		}
+	while (held || tud_midi_n_packet_read(0, packet)) {
+		held = (process_packet(packet) == MidiQueue::full);
+		if (held) return;
 	}
 }
 
@@ -139,46 +163,21 @@ void tud_midi_rx_cb(uint8_t itf)
 const auto MIDI = uart1;
 const auto MIDI_IRQ = UART1_IRQ;
 
+static MidiParser serial_parser;
+static volatile uint32_t serial_drops = 0;
+
 void midi_serial_irq()
 {
-	static uint8_t buf[4] = { 0, };
-	static uint8_t pos = 1;
-	static uint8_t len = 0;
-	static bool sysex = false;
-
 	while (uart_is_readable(MIDI)) {
 		uint8_t in = uart_getc(MIDI);
 
-		// ignore MIDI realtime messages
-		if (in >= 0xf8) continue;
-
-		// (mostly) ignore SysEx messages
-		if (sysex) {
-			if (in & 0x80) {
-				sysex = false;
-			} else {
-				continue;
-			}
-		}
-
-		// process command bytes
-		if (in & 0x80) {
-			if (in == 0xf0) {
-				sysex = true;
-				continue;
-			} else if (in >= 0x80) {
-				pos = 1;
-				buf[pos++] = in;
-				len = ((in & 0xe0) == 0xc0) ? 2 : 3;
-			}
-			continue;
-		}
-
-		// process data bytes
-		buf[pos] = in;
-		if (pos++ == len) {
-			process_packet(buf);
-			pos = 2;
+		// realtime and SysEx messages are parsed, but not yet used -
+		// serial MIDI can't be held off, so with the queue full the
+		// message is dropped
+		if (serial_parser.parse(in) == MidiParser::message &&
+			process_packet(serial_parser.packet()) == MidiQueue::full)
+		{
+			++serial_drops;
 		}
 	}
 }
@@ -201,48 +200,223 @@ void midi_init()
 // Audio Task
 //--------------------------------------------------------------------+
 
-int32_t samples[2 * BUFFER_SIZE];
+// blocks are rendered on core 1 and passed to core 0, which runs the
+// effects and outputs one block while core 1 renders the next - this
+// adds exactly one block of latency
+struct render_block {
+	int32_t		samples[2 * BUFFER_SIZE];
+	int32_t		chorus[BUFFER_SIZE];
+	int32_t		reverb[BUFFER_SIZE];
+	bool		silent;			// nothing rendered, buffers left as they were
+};
 
-void audio_task(void)
+static const uint8_t nblocks = 2;
+static render_block blocks[nblocks];
+static queue_t free_queue;			// block numbers, core 0 -> core 1
+static queue_t ready_queue;			// block numbers, core 1 -> core 0
+
+static Effects effects;
+
+void audio_task(render_block& block)
 {
-	uint32_t t0 = bench_time();
+	// with no voices in use, pass on silence without touching the engine
+	// or the block's buffers
+	block.silent = engine.idle();
+	if (block.silent) return;
 
-	// clear accumulation buffer
-	memset(samples, 0, sizeof(samples));
+	// clear accumulation buffers
+	memset(block.samples, 0, sizeof(block.samples));
+	memset(block.chorus, 0, sizeof(block.chorus));
+	memset(block.reverb, 0, sizeof(block.reverb));
+
+	uint32_t t0 = bench_time();
 
 	// get samples from the synth engine
-	uint32_t data = engine.update(samples, BUFFER_SIZE);
+	uint32_t voices = engine.update(block.samples, BUFFER_SIZE,
+		block.chorus, block.reverb);
 
 	uint32_t t1 = bench_time();
 	bench_entry entry = {
 		4 * bench_delta(t0, t1),
-		data
+		voices
 	};
 
 	queue_add_blocking(&bench_queue, &entry);
+}
 
-	struct audio_buffer *buffer = take_audio_buffer(ap, true);
-	int16_t *out = (int16_t *) buffer->buffer->bytes;
+void audio_loop(void)
+{
+	bench_init();
 
-	for (auto i = 0U; i < 2 * buffer->max_sample_count; ++i) {
-		out[i] = samples[i] >> 6;
+	while (true) {
+		uint8_t b;
+		queue_remove_blocking(&free_queue, &b);
+#if CONFIG_MIDI_FLOOD
+		uint32_t t0 = bench_time();
+#endif
+		midi_queue.drain(engine);
+		audio_task(blocks[b]);
+#if CONFIG_MIDI_FLOOD
+		flood.block(bench_delta(t0, bench_time()));
+#endif
+		queue_add_blocking(&ready_queue, &b);
 	}
+}
 
-	buffer->sample_count = buffer->max_sample_count;
-	give_audio_buffer(ap, buffer);
+//--------------------------------------------------------------------+
+// Idle power saving (core 0)
+//--------------------------------------------------------------------+
+
+// Once core 1 has passed on silent blocks for long enough for the
+// effects' tails to die away, the effects are cleared and no longer
+// run.  After CONFIG_IDLE_CLOCK_MS of silence the system clock and core
+// voltage are lowered, until the next channel voice message brings them
+// back - a host's MIDI clock or active sensing doesn't count.  That
+// takes a couple of milliseconds, less than one block, and the
+// message itself is queued for the engine as usual in the meantime.
+
+static const uint32_t full_clock_khz = 250000;
+static const uint32_t block_us = BUFFER_SIZE * 1000000ULL / SAMPLE_RATE;
+static const uint32_t tail_blocks = 2000000 / block_us;				// 2 s
+static const uint32_t idle_clock_blocks = CONFIG_IDLE_CLOCK_MS * 1000ULL / block_us;
+
+static uint32_t silent_blocks = 0;
+static bool clock_lowered = false;
+
+static void set_clock(uint32_t khz)
+{
+	set_sys_clock_khz(khz, false);
+
+	// the I2S and UART clocks follow clk_sys
+	audio_clock_changed();
+	uart_set_baudrate(MIDI, 31250);
+#ifdef uart_default
+	uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
 }
 
-void audio_loop(void)
+static void full_speed()
 {
-	bench_init();
+	vreg_set_voltage(VREG_VOLTAGE_1_30);
+	sleep_ms(1);
+	set_clock(full_clock_khz);
+}
 
-	while (true) {
-		uint8_t msg[4];
-		while (queue_try_remove(&midi_queue, msg)) {
-			engine.midi_in(msg[1], msg[2], msg[3]);
+// counts the silent blocks from core 1, returning true once the
+// effects can be skipped
+static bool idle_block(bool silent)
+{
+	if (!silent) {
+		silent_blocks = 0;
+		return false;
+	}
+
+	if (silent_blocks < tail_blocks) {
+		if (++silent_blocks == tail_blocks) {
+			effects.clear();
 		}
-		audio_task();
+		return false;
 	}
+
+	if (silent_blocks < idle_clock_blocks) {
+		++silent_blocks;
+	}
+	return true;
+}
+
+void power_task()
+{
+	if (wake) {
+		wake = false;
+		silent_blocks = 0;
+		if (clock_lowered) {
+			full_speed();
+			clock_lowered = false;
+		}
+		return;
+	}
+
+	// only once the effects have stopped, as they need the full clock
+	if (!clock_lowered && idle_clock_blocks &&
+		silent_blocks >= idle_clock_blocks && silent_blocks >= tail_blocks)
+	{
+		set_clock(CONFIG_IDLE_CLOCK_KHZ);
+		vreg_set_voltage(CONFIG_IDLE_VOLTAGE);
+		clock_lowered = true;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Effects and output (core 0)
+//--------------------------------------------------------------------+
+
+// records whether an output buffer holds only silence, returning
+// whether it already did - so that idle blocks needn't clear it again
+static bool silent_buffer(const audio_buffer* buffer, bool silent)
+{
+	static const audio_buffer* cleared[4] = {};		// pool has 3 buffers
+
+	for (auto& c : cleared) {
+		if (c == buffer) {
+			if (!silent) c = nullptr;
+			return true;
+		}
+	}
+	if (silent) {
+		for (auto& c : cleared) {
+			if (!c) {
+				c = buffer;
+				break;
+			}
+		}
+	}
+	return false;
+}
+
+void output_task(void)
+{
+	static struct audio_buffer *buffer = nullptr;
+
+	// don't hold up USB waiting for either I2S or the engine
+	if (!buffer) {
+		buffer = take_audio_buffer(ap, false);
+		if (!buffer) return;
+	}
+
+	uint8_t b;
+	if (!queue_try_remove(&ready_queue, &b)) return;
+
+	auto& block = blocks[b];
+	int16_t *out = (int16_t *) buffer->buffer->bytes;
+
+	if (idle_block(block.silent)) {
+		// the pool's buffers are cleared once each, not every block
+		if (!silent_buffer(buffer, true)) {
+			memset(out, 0, 4 * buffer->max_sample_count);
+		}
+	} else {
+		silent_buffer(buffer, false);
+
+		// core 1 leaves a silent block's buffers as they were, so the
+		// effects' tail runs from cleared samples and empty sends
+		if (block.silent) {
+			static int32_t no_send[BUFFER_SIZE];		// stays zero, in SRAM
+			memset(block.samples, 0, sizeof(block.samples));
+			effects.process(block.samples, no_send, no_send, BUFFER_SIZE);
+		} else {
+			effects.process(block.samples, block.chorus, block.reverb, BUFFER_SIZE);
+		}
+
+		for (auto i = 0U; i < 2 * buffer->max_sample_count; ++i) {
+			out[i] = clamp16(block.samples[i] >> 6);
+		}
+	}
+
+	buffer->sample_count = buffer->max_sample_count;
+	give_audio_buffer(ap, buffer);
+	buffer = nullptr;
+
+	queue_add_blocking(&free_queue, &b);
 }
 
 //--------------------------------------------------------------------+
@@ -279,31 +453,26 @@ void lcd_init()
 // Benchmarking
 //--------------------------------------------------------------------+
 
-template <typename T>
-inline std::string int_to_hex(T val, size_t width=sizeof(T)*2)
-{
-    std::stringstream ss;
-    ss << std::setfill('0') << std::setw(width) << std::hex << (val|0);
-    return ss.str();
-}
-
 void benchmark_task()
 {
 	static uint32_t start_ms = 0;
 	static uint32_t bench_min = 0xffffffff, bench_max = 0;
-	static uint32_t data;
+	static uint32_t voices = 0, per_voice = 0;
 
 	bench_entry entry;
 	while (queue_try_remove(&bench_queue, &entry)) {
 		uint32_t& delta = entry.delta;
 		if (delta < bench_min) {
 			bench_min = delta;
-		} else if (delta > bench_max) {
+		}
+		if (delta > bench_max) {
 			bench_max = delta;
 		}
 
-		if (data != entry.data) {
-			data = entry.data;
+		// per-voice block cost, including the fixed per-block overhead
+		voices = entry.voices;
+		if (voices) {
+			per_voice = delta / voices;
 		}
 	}
 
@@ -311,6 +480,11 @@ void benchmark_task()
 	if (board_millis() - start_ms < 250) return;
 	start_ms += 250;
 
+	// no blocks rendered this interval while the engine is idle
+	if (bench_min > bench_max) {
+		bench_min = bench_max = 0;
+	}
+
 #if CONFIG_LCD_ACTIVE
 	using namespace pimoroni;
 	graphics->set_pen(0, 0, 0);
@@ -318,9 +492,19 @@ void benchmark_task()
 	graphics->set_pen(255, 255, 255);
 	graphics->text(std::to_string(bench_min), Point(4,  4), 120);
 	graphics->text(std::to_string(bench_max), Point(4, 20), 120);
-	graphics->text(int_to_hex(data), Point(4, 36), 120);
+	graphics->text(std::to_string(voices), Point(4, 36), 120);
+	graphics->text(std::to_string(per_voice), Point(4, 52), 120);
 	lcd->update(graphics);
 #endif
+
+#if CONFIG_BENCH_PRINT
+	printf("bench: min %lu max %lu voices %lu per-voice %lu serial drops %lu\n",
+		bench_min, bench_max, voices, per_voice, serial_drops);
+#endif
+
+	// report each interval's extremes, not the all-time ones
+	bench_min = 0xffffffff;
+	bench_max = 0;
 }
 
 //--------------------------------------------------------------------+
@@ -333,7 +517,7 @@ int main() {
 
 	vreg_set_voltage(VREG_VOLTAGE_1_30);
 	sleep_ms(1);
-	set_sys_clock_khz(250000, false);
+	set_sys_clock_khz(full_clock_khz, false);
 
 	board_init();
 	ap = audio_init();
@@ -341,14 +525,40 @@ int main() {
 	tusb_init();
 	midi_init();
 
-	queue_init(&midi_queue, 4, 64);
+#if CONFIG_BENCH_SWEEP
+	// benchmark the engine (on core 0) before starting it up
+	bench_sweep(engine);
+	bench_parser();
+#endif
+
+	midi_queue.init();
 	queue_init(&bench_queue, sizeof(bench_entry), 64);
 
+	queue_init(&free_queue, sizeof(uint8_t), nblocks);
+	queue_init(&ready_queue, sizeof(uint8_t), nblocks);
+	for (uint8_t b = 0; b < nblocks; ++b) {
+		queue_add_blocking(&free_queue, &b);
+	}
+
+	printf("audio: effects pipeline adds %u samples (%lu us) of latency\n",
+		BUFFER_SIZE, (uint32_t)(BUFFER_SIZE * 1000000ULL / SAMPLE_RATE));
+
+#if CONFIG_MIDI_FLOOD
+	// generated MIDI traffic, in place of (as well as) USB and serial
+	flood.begin(midi_queue, time_us_64());
+#endif
+
 	multicore_launch_core1(audio_loop);
 
 	while (1)
 	{
 		tud_task();
+		usb_midi_task();
+#if CONFIG_MIDI_FLOOD
+		flood.produce(midi_queue, time_us_64());
+#endif
+		output_task();
+		power_task();
 		led_blinking_task();
 		benchmark_task();
 	}
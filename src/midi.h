@@ -4,9 +4,45 @@
 
 enum CC : uint8_t {
 	modwheel	= 1,
+	breath		= 2,
+	foot		= 4,
+	data_entry_msb	= 6,
+	data_entry_lsb	= 38,
 	volume		= 7,
 	pan			= 10,
 	expression	= 11,
+	general_1	= 16,
+	general_2	= 17,
+	general_3	= 18,
+	general_4	= 19,
 	sustain		= 64,
-	portamento	= 65
+	portamento	= 65,
+	sostenuto	= 66,
+	soft_pedal	= 67,
+	legato		= 68,
+	hold_2		= 69,
+	brightness	= 74,			// MPE timbre
+	reverb_send	= 91,
+	chorus_send	= 93,
+	data_increment	= 96,
+	data_decrement	= 97,
+	nrpn_lsb	= 98,
+	nrpn_msb	= 99,
+	rpn_lsb		= 100,
+	rpn_msb		= 101,
+
+	// channel mode messages
+	all_sound_off	= 120,
+	reset_all		= 121,
+	all_notes_off	= 123,
+	omni_off		= 124,
+	omni_on			= 125,
+	mono_on			= 126,
+	poly_on			= 127
+};
+
+// registered parameter numbers
+enum RPN : uint16_t {
+	rpn_bend_range	= 0x0000,
+	rpn_mpe_config	= 0x0006
 };
@@ -0,0 +1,240 @@
+#include <cstdio>
+
+#include "bench.h"
+#include "settings.h"
+#include "midi.h"
+#include "midi_flood.h"
+#include "midi_queue.h"
+
+const uint32_t MidiFlood::rates[nrates] = {
+	500, 1000, 2000, 4000, 8000, 16000, 32000, 64000
+};
+
+static const char* const kind_names[MidiFlood::nkinds] = {
+	"notes", "controllers", "bend", "mixed"
+};
+
+static const uint8_t flood_ccs[] = {
+	modwheel, volume, pan, expression, brightness
+};
+
+//--------------------------------------------------------------------+
+// Traffic generation
+//--------------------------------------------------------------------+
+
+static inline void make_packet(uint8_t* out, uint8_t status, uint8_t d1, uint8_t d2)
+{
+	out[0] = status >> 4;				// cable 0
+	out[1] = status;
+	out[2] = d1;
+	out[3] = d2;
+}
+
+// the j'th note event, spread over all channels, with each channel
+// holding its last few notes - so that voices are being allocated,
+// released and stolen throughout
+static void note_event(uint8_t* out, uint32_t j)
+{
+	uint8_t chan = j & 0x0f;
+	uint32_t m = j >> 4;
+	uint32_t n = m >> 1;
+
+	if (m & 1) {
+		// release the note from three events back, or the first note
+		// while there aren't three yet
+		n = (n < 3) ? 0 : n - 3;
+		make_packet(out, 0x80 | chan, 36 + (n * 5) % 48, 0);
+	} else {
+		make_packet(out, 0x90 | chan, 36 + (n * 5) % 48, 100);
+	}
+}
+
+static void cc_event(uint8_t* out, uint32_t j)
+{
+	uint8_t chan = j & 0x0f;
+	uint32_t m = j >> 4;
+	uint8_t cc = flood_ccs[m % sizeof(flood_ccs)];
+	make_packet(out, 0xb0 | chan, cc, (m * 3) & 0x7f);
+}
+
+static void bend_event(uint8_t* out, uint32_t j)
+{
+	uint8_t chan = j & 0x0f;
+	uint16_t v = ((j >> 4) * 37) & 0x3fff;
+	make_packet(out, 0xe0 | chan, v & 0x7f, v >> 7);
+}
+
+// events sent at the start of the stage, not counted in its rate
+uint32_t MidiFlood::prelude() const
+{
+	if (kind == notes || kind == nkinds) {
+		return silence;
+	}
+	return silence + chord;
+}
+
+void MidiFlood::generate(uint8_t* out, uint32_t i) const
+{
+	if (i < silence) {
+		make_packet(out, 0xb0 | i, all_sound_off, 0);
+		return;
+	}
+	i -= silence;
+
+	if (kind != notes) {
+		if (i < chord) {
+			make_packet(out, 0x90 | (i & 0x0f), 48 + 7 * (i >> 4), 100);
+			return;
+		}
+		i -= chord;
+	}
+
+	switch (kind) {
+		case notes:
+			note_event(out, i);
+			break;
+		case controllers:
+			cc_event(out, i);
+			break;
+		case bend:
+			bend_event(out, i);
+			break;
+		default:
+			// one note event to two controllers and one bend
+			switch (i & 3) {
+				case 0:
+					note_event(out, i >> 2);
+					break;
+				case 3:
+					bend_event(out, i >> 2);
+					break;
+				default:
+					cc_event(out, i >> 1);
+					break;
+			}
+			break;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Producer side (core 0)
+//--------------------------------------------------------------------+
+
+void MidiFlood::begin(MidiQueue& queue, uint64_t now)
+{
+	deadline = (uint64_t)bench_ticks_per_second() * BUFFER_SIZE / SAMPLE_RATE;
+
+	active = true;
+	kind = notes;
+	stage = 0;
+	sustained = 0;
+	first_miss = 0;
+
+	printf("flood,kind,rate,achieved,high_water,stalls,blocks,misses,unit,worst,deadline\n");
+
+	begin_stage(queue, now);
+}
+
+void MidiFlood::begin_stage(MidiQueue& queue, uint64_t now)
+{
+	uint8_t peak;
+	uint32_t stalls;
+	queue.take_stats(peak, stalls);
+
+	start = now;
+	sent = 0;
+	blocks_start = blocks;
+	misses_start = misses;
+	reset_worst = true;
+}
+
+void MidiFlood::end_stage(MidiQueue& queue, uint64_t now)
+{
+	uint8_t peak;
+	uint32_t stalls;
+	queue.take_stats(peak, stalls);
+
+	uint32_t rate = rates[stage];
+	uint32_t events = sent > prelude() ? sent - prelude() : 0;
+	uint32_t achieved = (uint64_t)events * 1000000 / (now - start);
+	uint32_t nblocks = blocks - blocks_start;
+	uint32_t nmisses = misses - misses_start;
+
+	printf("flood,%s,%lu,%lu,%u,%lu,%lu,%lu," BENCH_UNIT ",%lu,%lu\n",
+		kind_names[kind], (unsigned long)rate, (unsigned long)achieved,
+		peak, (unsigned long)stalls, (unsigned long)nblocks,
+		(unsigned long)nmisses, (unsigned long)worst, (unsigned long)deadline);
+
+	// kept up if within 1% of the target and never late
+	if (!nmisses && (uint64_t)achieved * 100 >= (uint64_t)rate * 99) {
+		sustained = rate;
+	}
+	if (nmisses && !first_miss) {
+		first_miss = rate;
+	}
+
+	if (++stage == nrates) {
+		printf("flood: %s sustained %lu events/s, ", kind_names[kind],
+			(unsigned long)sustained);
+		if (first_miss) {
+			printf("deadlines missed from %lu events/s\n", (unsigned long)first_miss);
+		} else {
+			printf("no deadlines missed\n");
+		}
+
+		stage = 0;
+		sustained = 0;
+		first_miss = 0;
+		++kind;
+	}
+
+	begin_stage(queue, now);
+}
+
+void MidiFlood::produce(MidiQueue& queue, uint64_t now)
+{
+	if (!active) return;
+
+	uint32_t due;
+	if (kind == nkinds) {
+		// finished - just silence everything
+		due = silence;
+	} else {
+		if (now - start >= stage_us) {
+			end_stage(queue, now);
+		}
+		due = prelude() + (uint64_t)rates[stage] * (now - start) / 1000000;
+	}
+
+	// never wait for the engine, anything left over is sent next time
+	uint8_t packet[4];
+	while (sent < due) {
+		generate(packet, sent);
+		if (queue.try_push(packet) == MidiQueue::full) return;
+		++sent;
+	}
+
+	if (kind == nkinds) {
+		active = false;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Consumer side (core 1)
+//--------------------------------------------------------------------+
+
+void MidiFlood::block(uint32_t delta)
+{
+	if (reset_worst) {
+		worst = 0;
+		reset_worst = false;
+	}
+
+	if (delta > worst) {
+		worst = delta;
+	}
+	if (delta > deadline) {
+		++misses;
+	}
+	++blocks;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+class MidiQueue;
+
+//
+// MIDI flood stress test - ramps the rate of generated note, controller
+// and pitch bend traffic through the MIDI queue, to find the highest
+// event rate the engine can absorb without missing the block deadline.
+//
+// The producer side runs where MIDI input normally arrives (core 0 on
+// the device) and is paced by the caller's clock.  It never waits for
+// the engine - events that don't fit in the queue are retried on the
+// next call, so a backlog shows up as an achieved rate below the
+// target.  The consumer side reports the time taken to drain the
+// queue and render each block.
+//
+// Each stage prints a CSV row, and each kind of traffic a summary of
+// the highest sustained rate and the rate at which deadlines were
+// first missed.
+//
+class MidiFlood {
+
+public:
+	enum Kind : uint8_t {
+		notes = 0,						// note on / off pairs
+		controllers,					// CCs over held notes
+		bend,							// pitch bend over held notes
+		mixed,
+		nkinds
+	};
+
+private:
+	static const uint8_t	nrates = 8;
+	static const uint32_t	rates[nrates];		// events per second
+	static const uint32_t	stage_us = 1000000;
+
+	// events sent at the start of each stage, ahead of the traffic
+	static const uint8_t	silence = 16;		// all sound off, per channel
+	static const uint8_t	chord = 32;			// held notes, 2 per channel
+
+	// producer (core 0)
+	bool					active = false;
+	uint8_t					kind = 0;
+	uint8_t					stage = 0;
+	uint64_t				start = 0;			// stage start time, us
+	uint32_t				sent = 0;			// events sent this stage
+
+	uint32_t				sustained = 0;		// highest rate kept up
+	uint32_t				first_miss = 0;		// lowest rate with misses
+	uint32_t				blocks_start = 0;
+	uint32_t				misses_start = 0;
+
+	// consumer (core 1)
+	volatile uint32_t		blocks = 0;
+	volatile uint32_t		misses = 0;
+	volatile uint32_t		worst = 0;
+	volatile bool			reset_worst = false;
+	uint32_t				deadline = 0;		// block period, in bench ticks
+
+private:
+	uint32_t				prelude() const;
+	void					generate(uint8_t* out, uint32_t i) const;
+	void					begin_stage(MidiQueue& queue, uint64_t now);
+	void					end_stage(MidiQueue& queue, uint64_t now);
+
+public:
+	void					begin(MidiQueue& queue, uint64_t now);
+	bool					running() const { return active; }
+
+	// sends the events due by now, in us
+	void					produce(MidiQueue& queue, uint64_t now);
+
+	// records the time taken by a block, in bench ticks
+	void					block(uint32_t delta);
+
+};
@@ -0,0 +1,159 @@
+#include "midi_parser.h"
+
+//--------------------------------------------------------------------+
+// Utility functions
+//--------------------------------------------------------------------+
+
+// number of data bytes following a (non-SysEx) status byte
+static inline uint8_t data_length(uint8_t status)
+{
+	switch (status & 0xf0) {
+		case 0xc0:
+		case 0xd0:
+			return 1;
+		case 0xf0:
+			switch (status) {
+				case 0xf1:
+				case 0xf3:
+					return 1;
+				case 0xf2:
+					return 2;
+				default:
+					return 0;
+			}
+		default:
+			return 2;
+	}
+}
+
+// USB MIDI code index number for a complete (non-SysEx) message
+static inline uint8_t cin(uint8_t status, uint8_t len)
+{
+	if (status < 0xf0) {
+		return status >> 4;
+	}
+
+	// system common, by length
+	switch (len) {
+		case 0:
+			return 0x5;
+		case 1:
+			return 0x2;
+		default:
+			return 0x3;
+	}
+}
+
+//--------------------------------------------------------------------+
+// Parser
+//--------------------------------------------------------------------+
+
+MidiParser::Result MidiParser::emit()
+{
+	out[0] = cin(status, needed);
+	out[1] = status;
+	out[2] = needed > 0 ? data[0] : 0;
+	out[3] = needed > 1 ? data[1] : 0;
+	count = 0;
+	++counters.messages;
+
+	// system common messages cancel running status
+	if (status >= 0xf0) {
+		status = 0;
+	}
+
+	return message;
+}
+
+// handles a (non-realtime) status byte
+MidiParser::Result MidiParser::start(uint8_t byte)
+{
+	// a new status before the current message is complete
+	if (status && count) {
+		++counters.truncated;
+	}
+	count = 0;
+
+	// end (or interruption) of SysEx
+	if (in_sysex) {
+		in_sysex = false;
+		if (byte == 0xf7) {
+			if (overflow) {
+				++counters.sysex_overflow;
+				return none;
+			}
+			if (sysex_len < sysex_size) {
+				sysex_buf[sysex_len++] = byte;
+				++counters.sysex;
+				return sysex;
+			}
+			++counters.sysex_overflow;
+			return none;
+		}
+		++counters.truncated;
+	}
+
+	if (byte == 0xf0) {
+		in_sysex = true;
+		overflow = false;
+		sysex_len = 0;
+		sysex_buf[sysex_len++] = byte;
+		status = 0;
+		return none;
+	}
+
+	if (byte == 0xf7) {						// stray end of SysEx
+		++counters.stray_data;
+		status = 0;
+		return none;
+	}
+
+	status = byte;
+	needed = data_length(byte);
+
+	// e.g. tune request, which has no data
+	if (needed == 0) {
+		return emit();
+	}
+
+	return none;
+}
+
+MidiParser::Result MidiParser::parse(uint8_t byte)
+{
+	++counters.bytes;
+
+	// realtime bytes may appear anywhere and don't affect any state
+	if (byte >= 0xf8) {
+		out[0] = 0x0f;
+		out[1] = byte;
+		out[2] = 0;
+		out[3] = 0;
+		return realtime;
+	}
+
+	if (byte & 0x80) {
+		return start(byte);
+	}
+
+	if (in_sysex) {
+		if (sysex_len < sysex_size) {
+			sysex_buf[sysex_len++] = byte;
+		} else {
+			overflow = true;
+		}
+		return none;
+	}
+
+	if (!status) {
+		++counters.stray_data;
+		return none;
+	}
+
+	data[count++] = byte;
+	if (count == needed) {
+		return emit();
+	}
+
+	return none;
+}
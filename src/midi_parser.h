@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+//
+// Streaming parser for a MIDI 1.0 byte stream, e.g. from a serial port.
+//
+// Handles running status, realtime bytes interleaved anywhere in the
+// stream (including inside other messages and SysEx), and system common
+// messages.  Complete messages are returned as USB MIDI event packets
+// (on cable 0) so they can take the same path as USB MIDI input.
+//
+// SysEx is collected into a fixed size buffer - messages that don't
+// fit are counted and dropped.  No memory is allocated, and each byte
+// costs a few tens of cycles so it can be called from an interrupt.
+//
+class MidiParser {
+
+public:
+	enum Result : uint8_t {
+		none = 0,						// nothing complete yet
+		message,						// channel or system common message
+		realtime,						// single byte realtime message
+		sysex,							// complete SysEx in the buffer
+	};
+
+	struct Counters {
+		uint32_t			bytes;
+		uint32_t			messages;
+		uint32_t			sysex;
+		uint32_t			sysex_overflow;		// dropped as too long
+		uint32_t			stray_data;			// data with no status
+		uint32_t			truncated;			// cut short by a new status
+	};
+
+	static const uint16_t	sysex_size = 128;
+
+private:
+	uint8_t					status = 0;			// current (running) status
+	uint8_t					needed = 0;			// data bytes per message
+	uint8_t					count = 0;			// data bytes received
+	uint8_t					data[2];
+	uint8_t					out[4];
+
+	bool					in_sysex = false;
+	bool					overflow = false;
+	uint16_t				sysex_len = 0;
+	uint8_t					sysex_buf[sysex_size];
+
+	Counters				counters = {};
+
+private:
+	Result					start(uint8_t byte);
+	Result					emit();
+
+public:
+	Result					parse(uint8_t byte);
+
+	// the last message or realtime byte, as a USB MIDI event packet
+	const uint8_t*			packet() const { return out; }
+
+	// the last complete SysEx, including the F0 and F7 bytes
+	const uint8_t*			sysex_data() const { return sysex_buf; }
+	uint16_t				sysex_length() const { return sysex_len; }
+
+	const Counters&			stats() const { return counters; }
+
+};
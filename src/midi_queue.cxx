@@ -0,0 +1,240 @@
+#include "pico/stdlib.h"
+
+#include "midi_queue.h"
+#include "engine.h"
+#include "midi.h"
+
+//--------------------------------------------------------------------+
+// Utility functions
+//--------------------------------------------------------------------+
+
+// controllers for which only the latest value matters - switches,
+// RPN / NRPN data entry and the channel mode messages must all keep
+// their original order
+static inline bool continuous(uint8_t cc)
+{
+	return !(cc == data_entry_msb || cc == data_entry_lsb ||
+			 (cc >= sustain && cc <= hold_2) ||
+			 (cc >= data_increment && cc <= rpn_msb) ||
+			 cc >= all_sound_off);
+}
+
+// the part addressed by a USB MIDI packet - packets on cables beyond
+// MIDI_PORTS are dropped before they're queued, so masking the cable
+// number only keeps the part in range
+static inline uint8_t part_of(const uint8_t* packet)
+{
+	return (((packet[0] >> 4) & (MIDI_PORTS - 1)) << 4) | (packet[1] & 0x0f);
+}
+
+//--------------------------------------------------------------------+
+// Producer side (core 0)
+//--------------------------------------------------------------------+
+
+void MidiQueue::init()
+{
+	critical_section_init(&lock);
+}
+
+// stores the packet in the pending set if it's a coalescable message
+bool MidiQueue::coalesce(const uint8_t* packet)
+{
+	uint8_t cmd = packet[1] >> 4;
+	uint8_t part = part_of(packet);
+	auto& p = pending[active];
+
+	switch (cmd) {
+		case 0xb: {
+			uint8_t cc = packet[2] & 0x7f;
+			if (!continuous(cc)) return false;
+			p.cc[part][cc] = packet[3];
+			p.dirty[part][cc >> 5] |= (1U << (cc & 31));
+			break;
+		}
+		case 0xd:
+			p.pressure[part] = packet[2];
+			p.flags[part] |= pending_pressure;
+			break;
+		case 0xe:
+			p.bend[part][0] = packet[2];
+			p.bend[part][1] = packet[3];
+			p.flags[part] |= pending_bend;
+			break;
+		default:
+			return false;
+	}
+
+	p.parts |= (1U << part);
+	return true;
+}
+
+void MidiQueue::append(const uint8_t* packet)
+{
+	auto* out = fifo[(head + count) % size];
+	for (uint8_t i = 0; i < 4; ++i) {
+		out[i] = packet[i];
+	}
+	if (++count > high_water) {
+		high_water = count;
+	}
+}
+
+// moves as much of the part's pending state into the FIFO as will
+// fit, returning true once there's nothing left pending
+bool MidiQueue::flush(uint8_t part)
+{
+	auto& p = pending[active];
+	if (!(p.parts & (1U << part))) return true;
+
+	uint8_t cable = (part >> 4) << 4;
+	uint8_t chan = part & 0x0f;
+	uint8_t msg[4] = { 0, 0, 0, 0 };
+
+	for (uint8_t i = 0; i < 4; ++i) {
+		auto& dirty = p.dirty[part][i];
+		while (dirty) {
+			if (count == size) return false;
+			uint8_t bit = __builtin_ctz(dirty);
+			uint8_t cc = (i << 5) + bit;
+			msg[0] = cable | 0x0b;
+			msg[1] = 0xb0 | chan;
+			msg[2] = cc;
+			msg[3] = p.cc[part][cc];
+			append(msg);
+			dirty &= ~(1U << bit);
+		}
+	}
+
+	if (p.flags[part] & pending_pressure) {
+		if (count == size) return false;
+		msg[0] = cable | 0x0d;
+		msg[1] = 0xd0 | chan;
+		msg[2] = p.pressure[part];
+		msg[3] = 0;
+		append(msg);
+		p.flags[part] &= ~pending_pressure;
+	}
+
+	if (p.flags[part] & pending_bend) {
+		if (count == size) return false;
+		msg[0] = cable | 0x0e;
+		msg[1] = 0xe0 | chan;
+		msg[2] = p.bend[part][0];
+		msg[3] = p.bend[part][1];
+		append(msg);
+		p.flags[part] &= ~pending_bend;
+	}
+
+	p.parts &= ~(1U << part);
+	return true;
+}
+
+// adds the packet (under the lock) unless the engine must first make
+// room in the FIFO, in which case any pending controller state for the
+// part is flushed as far as possible and false is returned
+bool MidiQueue::insert(const uint8_t* packet)
+{
+	if (coalesce(packet)) return true;
+	if (!flush(part_of(packet)) || count == size) return false;
+
+	append(packet);
+	return true;
+}
+
+// queues a channel voice message unless the engine must first make room
+MidiQueue::Result MidiQueue::try_push(const uint8_t* packet)
+{
+	// the engine only consumes channel voice messages
+	uint8_t status = packet[1];
+	if (status < 0x80 || status >= 0xf0) return dropped;
+
+	critical_section_enter_blocking(&lock);
+
+	bool ok = insert(packet);
+	if (!ok) {
+		++stalls;
+	}
+
+	critical_section_exit(&lock);
+	return ok ? queued : full;
+}
+
+void MidiQueue::take_stats(uint8_t& peak, uint32_t& stalled)
+{
+	critical_section_enter_blocking(&lock);
+
+	peak = high_water;
+	stalled = stalls;
+	high_water = count;
+	stalls = 0;
+
+	critical_section_exit(&lock);
+}
+
+//--------------------------------------------------------------------+
+// Consumer side (core 1)
+//--------------------------------------------------------------------+
+
+void MidiQueue::dispatch(Pending& p, SynthEngine& engine)
+{
+	while (p.parts) {
+		uint8_t part = __builtin_ctz(p.parts);
+		uint8_t cable = part >> 4;
+		uint8_t chan = part & 0x0f;
+
+		for (uint8_t i = 0; i < 4; ++i) {
+			auto& dirty = p.dirty[part][i];
+			while (dirty) {
+				uint8_t bit = __builtin_ctz(dirty);
+				uint8_t cc = (i << 5) + bit;
+				engine.midi_in(0xb0 | chan, cc, p.cc[part][cc], cable);
+				dirty &= ~(1U << bit);
+			}
+		}
+
+		if (p.flags[part] & pending_pressure) {
+			engine.midi_in(0xd0 | chan, p.pressure[part], 0, cable);
+		}
+
+		if (p.flags[part] & pending_bend) {
+			engine.midi_in(0xe0 | chan, p.bend[part][0], p.bend[part][1], cable);
+		}
+
+		p.flags[part] = 0;
+		p.parts &= ~(1U << part);
+	}
+}
+
+void MidiQueue::drain(SynthEngine& engine)
+{
+	uint8_t msgs[size][4];
+	uint8_t n;
+
+	// take a snapshot of the FIFO and swap the pending sets, all
+	// under the lock so that the FIFO contents and the pending
+	// controller state are consistent with each other
+	critical_section_enter_blocking(&lock);
+
+	n = count;
+	for (uint8_t i = 0; i < n; ++i) {
+		auto* in = fifo[(head + i) % size];
+		for (uint8_t j = 0; j < 4; ++j) {
+			msgs[i][j] = in[j];
+		}
+	}
+	head = (head + n) % size;
+	count = 0;
+
+	auto& p = pending[active];
+	active ^= 1;
+
+	critical_section_exit(&lock);
+
+	// ordered messages first, then the coalesced state, which is
+	// always newer than anything in the FIFO for the same part
+	for (uint8_t i = 0; i < n; ++i) {
+		engine.midi_in(msgs[i][1], msgs[i][2], msgs[i][3], msgs[i][0] >> 4);
+	}
+
+	dispatch(p, engine);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+
+#include "pico/critical_section.h"
+
+#include "settings.h"
+
+class SynthEngine;
+
+//
+// Ingestion queue for MIDI packets passed from core 0 (USB and serial
+// MIDI) to the synth engine on core 1.
+//
+// Order-sensitive messages (notes, program changes, switch controllers,
+// channel mode messages) are queued in FIFO order.  Continuous
+// controllers, channel pressure and pitch bend are instead coalesced
+// per channel so that only the latest value reaches the engine, and a
+// controller flood can neither fill the FIFO nor be replayed in full
+// at the start of every block.
+//
+// Any pending controller state for a part (a channel on a given USB
+// MIDI cable) is flushed into the FIFO ahead of the next order-sensitive
+// message for that part, so the relative order of notes and controllers
+// within a part is kept.
+//
+// The producer never waits for room.  On the device, core 1 only drains
+// the queue after core 0 has passed it a block, so a full queue is
+// returned to the caller, which holds the packet back or drops it.
+//
+class MidiQueue {
+
+private:
+	static const uint8_t	size = 64;
+	static const uint8_t	nc = 16 * MIDI_PORTS;	// 16 channels on each cable
+
+	enum : uint8_t {
+		pending_pressure = 0x01,
+		pending_bend = 0x02,
+	};
+
+	struct Pending {
+		uint32_t			parts;				// bitmap of parts with pending state
+		uint8_t				flags[nc];
+		uint32_t			dirty[nc][4];		// bitmap of pending CCs
+		uint8_t				cc[nc][128];
+		uint8_t				bend[nc][2];
+		uint8_t				pressure[nc];
+	};
+
+private:
+	critical_section_t		lock;
+
+	uint8_t					fifo[size][4];
+	uint8_t					head = 0;
+	uint8_t					count = 0;
+
+	uint8_t					high_water = 0;		// most packets held in the FIFO
+	uint32_t				stalls = 0;			// pushes that found it full
+
+	// double-buffered so that core 1 can dispatch one set while
+	// core 0 continues to coalesce into the other
+	Pending					pending[2] = {};
+	uint8_t					active = 0;
+
+private:
+	bool					coalesce(const uint8_t* packet);
+	bool					flush(uint8_t part);
+	void					append(const uint8_t* packet);
+	bool					insert(const uint8_t* packet);
+	void					dispatch(Pending& p, SynthEngine& engine);
+
+public:
+	// channel voice messages are queued, and anything else dropped
+	enum Result : uint8_t {
+		queued,
+		dropped,
+		full,					// no room, try again after the next drain
+	};
+
+public:
+	void					init();
+	Result					try_push(const uint8_t* packet);
+	void					drain(SynthEngine& engine);
+
+	// FIFO high-water mark and stall count since the last call
+	void					take_stats(uint8_t& peak, uint32_t& stalled);
+
+};
@@ -2,25 +2,97 @@
 
 #include <stdint.h>
 
+// wavetable position sources
+enum {
+	WT_OFF = 0,				// DCO1 plays `dco_wave`
+	WT_FIXED,
+	WT_DCA_ENV,
+	WT_DCO_ENV,
+	WT_LFO,
+	WT_MODWHEEL,
+};
+
+// LFO modes
+enum {
+	LFO_FREE = 0,			// per-voice, free running
+	LFO_KEY_SYNC,			// per-voice, restarted on note on
+	LFO_SHARED,				// one LFO per channel, shared by all its voices
+};
+
+// modulation sources, all scaled to 8 bits
+enum {
+	MOD_NONE = 0,
+	MOD_VELOCITY,
+	MOD_KEY,				// bipolar, centred on middle C
+	MOD_WHEEL,
+	MOD_PRESSURE,			// channel pressure, or per-note with MPE
+	MOD_DCA_ENV,
+	MOD_DCO_ENV,
+	MOD_LFO,				// bipolar
+	MOD_CC = 0x80,			// MOD_CC + n = controller n
+};
+
+// modulation destinations
+enum {
+	DEST_PITCH = 0,			// full scale = one octave
+	DEST_AMP,				// attenuation only, full scale = silence
+	DEST_PAN,
+	DEST_FILTER,			// reserved - there's no filter yet
+	DEST_WT_POSITION,		// only when scanning the wavetable
+};
+
+typedef struct {
+	uint8_t				source;
+	uint8_t				dest;
+	int8_t				amount;
+} ModRoute;
+
+#define MAX_MOD_ROUTES	8
+
 typedef struct {
 
 	uint8_t				dco_wave;
 
+	uint8_t				dco2_wave;
+	uint8_t				dco2_level;			// 0 = off, 64 = equal mix, 128 (max) = DCO2 only
+	int8_t				dco2_coarse;		// semitones
+	int8_t				dco2_fine;			// cents
+
+	uint8_t				unison;				// DCO1 copies per note, 0/1 = off
+	uint8_t				unison_detune;		// cents between outermost copies
+	uint8_t				unison_spread;		// stereo width
+
+	uint8_t				wt_source;			// scan the wavetable instead of `dco_wave`
+	uint8_t				wt_position;		// base position in the wavetable
+	int8_t				wt_amount;			// position modulation depth
+
+	// envelope times are in milliseconds
 	uint8_t				dca_env_level;
-	uint8_t				dca_env_a;
-	uint8_t				dca_env_d;
+	uint16_t			dca_env_a;
+	uint16_t			dca_env_d;
 	uint8_t				dca_env_s;
-	uint8_t				dca_env_r;
+	uint16_t			dca_env_r;
 
 	uint8_t				dco_env_level;
-	uint8_t				dco_env_a;
-	uint8_t				dco_env_d;
+	uint16_t			dco_env_a;
+	uint16_t			dco_env_d;
 	uint8_t				dco_env_s;
-	uint8_t				dco_env_r;
+	uint16_t			dco_env_r;
 
 	uint8_t				lfo_wave;
 	uint8_t				lfo_depth;
 	uint8_t				lfo_freq;
+	uint8_t				lfo_mode;
+
+	// per-voice pan, relative to the channel's pan
+	int8_t				pan_key;			// key follow, 1/16ths of a step per semitone
+	uint8_t				pan_spread;			// width of random placement at note on
+	uint8_t				pan_lfo;			// LFO autopan depth
+
+	uint8_t				mono;				// one legato voice per channel
+	uint16_t			glide_time;			// portamento time in milliseconds
+
+	ModRoute			mod[MAX_MOD_ROUTES];
 
 } Patch;
 
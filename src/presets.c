@@ -5,10 +5,10 @@ Patch presets[] = {
 		.dco_wave		= 0,
 
 		.dca_env_level	= 127,
-		.dca_env_a		= 30,
-		.dca_env_d		= 20,
+		.dca_env_a		= 50,
+		.dca_env_d		= 150,
 		.dca_env_s		= 80,
-		.dca_env_r		= 20,
+		.dca_env_r		= 400,
 
 		.lfo_freq		= 64,
 		.lfo_depth		= 20,
@@ -17,14 +17,14 @@ Patch presets[] = {
 		.dco_wave		= 1,
 
 		.dca_env_level	= 100,
-		.dca_env_a		= 30,
-		.dca_env_d		= 20,
+		.dca_env_a		= 50,
+		.dca_env_d		= 150,
 		.dca_env_s		= 80,
-		.dca_env_r		= 20,
+		.dca_env_r		= 400,
 
 		.dco_env_level	= 0,
-		.dco_env_a		= 127,
-		.dco_env_d		= 40,
+		.dco_env_a		= 25,
+		.dco_env_d		= 150,
 		.dco_env_s		= 0,
 		.dco_env_r		= 0,
 
@@ -35,25 +35,31 @@ Patch presets[] = {
 		.dco_wave		= 2,
 
 		.dca_env_level	= 100,
-		.dca_env_a		= 30,
-		.dca_env_d		= 20,
+		.dca_env_a		= 50,
+		.dca_env_d		= 150,
 		.dca_env_s		= 80,
-		.dca_env_r		= 20,
+		.dca_env_r		= 400,
 
 		.lfo_freq		= 64,
 		.lfo_depth		= 127,
+
+		.mod = {
+			{ MOD_PRESSURE, DEST_PITCH, 4 },
+		},
 	},
 	{	// 3
 		.dco_wave		= 3,
 
 		.dca_env_level	= 127,
-		.dca_env_a		= 30,
-		.dca_env_d		= 20,
+		.dca_env_a		= 50,
+		.dca_env_d		= 150,
 		.dca_env_s		= 80,
-		.dca_env_r		= 20,
+		.dca_env_r		= 400,
 
 		.lfo_wave		= 1,
 		.lfo_freq		= 96,
 		.lfo_depth		= 31,
+
+		.pan_spread		= 64,
 	},
 };
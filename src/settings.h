@@ -0,0 +1,40 @@
+#pragma once
+
+//
+// Build configuration, normally set from CMake.  Everything else that
+// depends on it - the lookup tables included - is derived at compile
+// time.
+//
+
+#ifndef SAMPLE_RATE
+#define SAMPLE_RATE 44100
+#endif
+
+#ifndef BUFFER_SIZE
+#define BUFFER_SIZE 256
+#endif
+
+#ifndef WAVE_SHIFT
+#define WAVE_SHIFT  11
+#endif
+
+// engine capacity: voices, MIDI ports of 16 channels each (1 or 2),
+// and DCO1 copies per unison voice (1 disables unison)
+#ifndef MAX_VOICES
+#define MAX_VOICES  128
+#endif
+
+#ifndef MIDI_PORTS
+#define MIDI_PORTS  2
+#endif
+
+#ifndef MAX_UNISON
+#define MAX_UNISON  8
+#endif
+
+#define WAVE_LEN    (1 << WAVE_SHIFT)
+#define WAVE_MAX    (0x10000 << WAVE_SHIFT)
+
+// envelope segments advance a 20-bit position once per block, so a
+// segment of `t` milliseconds needs a step of ENV_RATE_SCALE / t
+#define ENV_RATE_SCALE ((uint32_t)((0x100000ULL * 1000 * BUFFER_SIZE + SAMPLE_RATE / 2) / SAMPLE_RATE))
@@ -0,0 +1,78 @@
+#include "pico.h"
+
+#include "settings.h"
+#include "tables.h"
+#include "waves.h"
+
+//
+// The lookup tables for this build's configuration, evaluated by the
+// compiler.  Each table can be placed in SRAM or left in flash; the
+// small tables read on every block default to flash, the waves read
+// on every sample default to SRAM.
+//
+
+#ifndef CONFIG_NOTE_TABLE_IN_SRAM
+#define CONFIG_NOTE_TABLE_IN_SRAM 0
+#endif
+
+#ifndef CONFIG_PAN_TABLE_IN_SRAM
+#define CONFIG_PAN_TABLE_IN_SRAM 0
+#endif
+
+#ifndef CONFIG_POWER_TABLE_IN_SRAM
+#define CONFIG_POWER_TABLE_IN_SRAM 0
+#endif
+
+#ifndef CONFIG_ENV_TABLE_IN_SRAM
+#define CONFIG_ENV_TABLE_IN_SRAM 0
+#endif
+
+#ifndef CONFIG_WAVES_IN_SRAM
+#define CONFIG_WAVES_IN_SRAM 1
+#endif
+
+#define PLACE_0
+#define PLACE_1 __not_in_flash("tables")
+#define PLACE_(in_sram) PLACE_##in_sram
+#define PLACE(in_sram) PLACE_(in_sram)
+
+//--------------------------------------------------------------------+
+// Pitch, pan and level tables
+//--------------------------------------------------------------------+
+
+PLACE(CONFIG_NOTE_TABLE_IN_SRAM)
+constexpr Table<uint32_t, 128> note_table = make_note_table<SAMPLE_RATE, WAVE_SHIFT>();
+
+PLACE(CONFIG_PAN_TABLE_IN_SRAM)
+constexpr Table<uint8_t, 128> pan_table = make_pan_table();
+
+PLACE(CONFIG_POWER_TABLE_IN_SRAM)
+constexpr Table<uint16_t, 16384> power_table = make_power_table();
+
+PLACE(CONFIG_ENV_TABLE_IN_SRAM)
+constexpr Table<uint16_t, 256> env_curve_table = make_env_curve_table();
+
+//--------------------------------------------------------------------+
+// Waves
+//--------------------------------------------------------------------+
+
+PLACE(CONFIG_WAVES_IN_SRAM)
+static constexpr Wave<WAVE_SHIFT> sine_wave = make_sine_wave<WAVE_SHIFT>();
+
+PLACE(CONFIG_WAVES_IN_SRAM)
+static constexpr Wave<WAVE_SHIFT> square_wave = make_square_wave<WAVE_SHIFT>();
+
+PLACE(CONFIG_WAVES_IN_SRAM)
+static constexpr Wave<WAVE_SHIFT> saw_wave = make_saw_wave<WAVE_SHIFT>();
+
+PLACE(CONFIG_WAVES_IN_SRAM)
+static constexpr Wave<WAVE_SHIFT> tri_wave = make_tri_wave<WAVE_SHIFT>();
+
+PLACE(CONFIG_WAVES_IN_SRAM)
+constexpr Table<int16_t, (size_t)wavetable_frames << WAVE_SHIFT> wavetable =
+	make_wavetable<WAVE_SHIFT, wavetable_frames>();
+
+// indexed by the patch wave numbers
+const int16_t* const waves[] = {
+	sine_wave.v, square_wave.v, saw_wave.v, tri_wave.v
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// Lookup tables, generated at compile time for a given sample rate and
+// wave size so that any number of configurations can be built from the
+// one source tree.  The tables for the build's own configuration are
+// defined in tables.cxx, placed in SRAM or flash as configured.
+//
+// The maths is done in double precision with constexpr versions of the
+// library functions, which are accurate to an ulp or two over the
+// ranges used here.
+//
+
+template <typename T, size_t N>
+struct Table {
+	T						v[N];
+
+	constexpr const T&		operator[](size_t i) const { return v[i]; }
+	constexpr T&			operator[](size_t i) { return v[i]; }
+	static constexpr size_t	size() { return N; }
+};
+
+//--------------------------------------------------------------------+
+// Compile-time maths
+//--------------------------------------------------------------------+
+
+constexpr double const_pi = 3.14159265358979323846;
+
+constexpr double const_floor(double x)
+{
+	double t = (double)(int64_t)x;
+	return (t > x) ? t - 1 : t;
+}
+
+// rounds halves upwards, as the original generator scripts did
+constexpr double const_round(double x)
+{
+	return const_floor(x + 0.5);
+}
+
+constexpr double const_exp(double x)
+{
+	// x = k ln 2 + r, with |r| <= ln 2 / 2 and ln 2 split in two
+	// so that k ln 2 is exact
+	const double ln2_hi = 6.93147180369123816490e-01;
+	const double ln2_lo = 1.90821492927058770002e-10;
+
+	double k = const_round(x / (ln2_hi + ln2_lo));
+	double r = (x - k * ln2_hi) - k * ln2_lo;
+
+	double sum = 1, term = 1;
+	for (int n = 1; n < 24; ++n) {
+		term *= r / n;
+		sum += term;
+	}
+
+	for (; k > 0; --k) sum *= 2;
+	for (; k < 0; ++k) sum /= 2;
+	return sum;
+}
+
+constexpr double const_exp2(double x)
+{
+	return const_exp(x * 0.693147180559945309417);
+}
+
+constexpr double const_sqrt(double x)
+{
+	if (x <= 0) return 0;
+
+	double y = (x > 1) ? x : 1;
+	for (int i = 0; i < 100; ++i) {
+		double next = (y + x / y) / 2;
+		if (next >= y) break;
+		y = next;
+	}
+	return y;
+}
+
+// sin(2 pi i / n) for n a multiple of four, reduced to the first
+// octant so that the quadrant points are exact
+constexpr double const_sin_turns(uint64_t i, uint64_t n)
+{
+	i %= n;
+	uint64_t q = n / 4;
+	bool negate = i >= 2 * q;
+	if (negate) i -= 2 * q;
+	if (i > q) i = 2 * q - i;
+
+	// sin x for x <= pi / 4, else cos of the complement
+	bool cosine = 2 * i > q;
+	double x = 2 * const_pi * (cosine ? q - i : i) / n;
+	double x2 = x * x;
+
+	double term = cosine ? 1 : x;
+	double sum = term;
+	for (int k = cosine ? 2 : 3; k < 32; k += 2) {
+		term *= -x2 / ((k - 1) * k);
+		sum += term;
+	}
+
+	return negate ? -sum : sum;
+}
+
+//--------------------------------------------------------------------+
+// Pitch, pan and level tables
+//--------------------------------------------------------------------+
+
+// DCO phase steps for each MIDI note, in 16.16 fixed point wave indices
+template <uint32_t sample_rate, uint8_t wave_shift>
+constexpr Table<uint32_t, 128> make_note_table()
+{
+	Table<uint32_t, 128> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		double f = 440.0 * const_exp2(((double)i - 69) / 12);
+		t[i] = (uint32_t)(0x10000 * (double)(1 << wave_shift) * f / sample_rate);
+	}
+	return t;
+}
+
+// 7-bit equal power pan levels
+constexpr Table<uint8_t, 128> make_pan_table()
+{
+	Table<uint8_t, 128> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = (uint8_t)(127 * const_sqrt(i / 127.0));
+	}
+	return t;
+}
+
+// 1:15 fixed-point multipliers for -1 ..< +1 octave, in 8192 steps
+// per octave
+constexpr Table<uint16_t, 16384> make_power_table()
+{
+	Table<uint16_t, 16384> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = (uint16_t)const_round(32768 * const_exp2(((double)i - 8192) / 8192));
+	}
+	return t;
+}
+
+// normalised exponential decay from 1.0 to 0.0 across an envelope segment
+constexpr Table<uint16_t, 256> make_env_curve_table()
+{
+	const double k = 5.0;
+	Table<uint16_t, 256> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		double v = (const_exp(-k * i / 256) - const_exp(-k)) / (1 - const_exp(-k));
+		t[i] = (uint16_t)const_round(65535 * v);
+	}
+	return t;
+}
+
+//--------------------------------------------------------------------+
+// Waves
+//--------------------------------------------------------------------+
+
+template <uint8_t wave_shift>
+using Wave = Table<int16_t, (size_t)1 << wave_shift>;
+
+template <uint8_t wave_shift>
+constexpr Wave<wave_shift> make_sine_wave()
+{
+	Wave<wave_shift> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = (int16_t)const_floor(32767 * const_sin_turns(i, t.size()));
+	}
+	return t;
+}
+
+template <uint8_t wave_shift>
+constexpr Wave<wave_shift> make_square_wave()
+{
+	Wave<wave_shift> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = (i < t.size() / 2) ? 32767 : -32768;
+	}
+	return t;
+}
+
+template <uint8_t wave_shift>
+constexpr Wave<wave_shift> make_saw_wave()
+{
+	Wave<wave_shift> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = (int16_t)(32767 - (int32_t)(i << (16 - wave_shift)));
+	}
+	return t;
+}
+
+template <uint8_t wave_shift>
+constexpr Wave<wave_shift> make_tri_wave()
+{
+	const size_t q = (size_t)1 << (wave_shift - 2);
+	const int32_t slope = 1 << (17 - wave_shift);
+
+	Wave<wave_shift> t = {};
+	for (size_t i = 0; i < t.size(); ++i) {
+		int32_t j = i;
+		t[i] = (i < q) ? j * slope :
+			   (i < 3 * q) ? 32767 - slope * (j - q) :
+			   -32768 + slope * (j - 3 * q);
+	}
+	return t;
+}
+
+// wavetable for scanning, stored as consecutive frames so that the same
+// offset in the next frame is always a fixed distance away.  Each frame
+// is a band-limited sawtooth with twice the harmonics of the previous,
+// sweeping from a pure sine to a bright saw.
+template <uint8_t wave_shift, uint8_t frames>
+constexpr Table<int16_t, (size_t)frames << wave_shift> make_wavetable()
+{
+	const size_t n = (size_t)1 << wave_shift;
+
+	Table<double, n> sine = {};
+	for (size_t i = 0; i < n; ++i) {
+		sine[i] = const_sin_turns(i, n);
+	}
+
+	Table<int16_t, (size_t)frames << wave_shift> t = {};
+	Table<double, n> frame = {};
+
+	// each frame adds the next octave of harmonics to the last
+	for (uint8_t k = 0; k < frames; ++k) {
+		uint32_t from = k ? (1U << (k - 1)) + 1 : 1;
+		double peak = 0;
+		for (size_t i = 0; i < n; ++i) {
+			double v = frame[i];
+			for (uint32_t h = from; h <= (1U << k); ++h) {
+				v += sine[(h * i) % n] / h;
+			}
+			frame[i] = v;
+			if (v > peak) peak = v;
+			if (-v > peak) peak = -v;
+		}
+
+		for (size_t i = 0; i < n; ++i) {
+			t[k * n + i] = (int16_t)const_round(32767 * frame[i] / peak);
+		}
+	}
+	return t;
+}
+
+//--------------------------------------------------------------------+
+// The build configuration's tables
+//--------------------------------------------------------------------+
+
+extern const Table<uint32_t, 128> note_table;
+extern const Table<uint8_t, 128> pan_table;
+extern const Table<uint16_t, 16384> power_table;
+extern const Table<uint16_t, 256> env_curve_table;
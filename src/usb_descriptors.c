@@ -32,6 +32,8 @@
 
 #include "pico/unique_id.h"
 
+#include "settings.h"
+
 /* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
  * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
  *
@@ -58,7 +60,7 @@ tusb_desc_device_t const desc_device =
     .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
     .idVendor           = 0xCafe,
     .idProduct          = USB_PID,
-    .bcdDevice          = 0x0100,
+    .bcdDevice          = 0x0101,
 
     .iManufacturer      = 0x01,
     .iProduct           = 0x02,
@@ -89,17 +91,45 @@ enum
   ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN)
+// virtual MIDI cables, each addressing a bank of 16 parts
+#define MIDI_CABLES       MIDI_PORTS
+#define EPSIZE_MIDI       (TUD_OPT_HIGH_SPEED ? 512 : 64)
+
+#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_HEAD_LEN + \
+                           MIDI_CABLES * TUD_MIDI_DESC_JACK_LEN + \
+                           2 * TUD_MIDI_DESC_EP_LEN(MIDI_CABLES))
 
 uint8_t const desc_configuration[] =
 {
   // Config number, interface count, string index, total length, attribute, power in mA
   TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 100),
 
-  // Interface number, string index, EP Out & EP In address, EP size
-  TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI_OUT, EPNUM_MIDI_IN, TUD_OPT_HIGH_SPEED ? 512 : 64),
+  // Interface number, string index, number of cables
+  TUD_MIDI_DESC_HEAD(ITF_NUM_MIDI, 0, MIDI_CABLES),
+
+  // Cable number, string index
+  TUD_MIDI_DESC_JACK_DESC(1, 4),
+#if MIDI_CABLES > 1
+  TUD_MIDI_DESC_JACK_DESC(2, 5),
+#endif
+
+  // EP Out address, EP size, number of cables, followed by the embedded jacks
+  TUD_MIDI_DESC_EP(EPNUM_MIDI_OUT, EPSIZE_MIDI, MIDI_CABLES),
+  TUD_MIDI_JACKID_IN_EMB(1),
+#if MIDI_CABLES > 1
+  TUD_MIDI_JACKID_IN_EMB(2),
+#endif
+
+  // EP In address, EP size, number of cables, followed by the embedded jacks
+  TUD_MIDI_DESC_EP(EPNUM_MIDI_IN, EPSIZE_MIDI, MIDI_CABLES),
+  TUD_MIDI_JACKID_OUT_EMB(1),
+#if MIDI_CABLES > 1
+  TUD_MIDI_JACKID_OUT_EMB(2),
+#endif
 };
 
+_Static_assert(sizeof(desc_configuration) == CONFIG_TOTAL_LEN, "MIDI descriptor length");
+
 // Invoked when received GET CONFIGURATION DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
@@ -119,6 +149,10 @@ char const* string_desc_arr [] = {
   "Ray Bellis",                  // 1: Manufacturer
   "PicoSynth",                   // 2: Product
   "123456",                      // 3: Serials, should use chip ID
+  "PicoSynth Parts 1-16",        // 4: MIDI cable 0
+#if MIDI_CABLES > 1
+  "PicoSynth Parts 17-32",       // 5: MIDI cable 1
+#endif
 };
 
 static uint16_t _desc_str[32];
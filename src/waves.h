@@ -1,18 +1,15 @@
 #pragma once
 
-#include <stdint.h>
-#include "settings.h"
-
-#ifdef __cplusplus
-extern "C" {
-#endif
+#include <cstdint>
 
-extern int16_t* waves[];
+#include "settings.h"
+#include "tables.h"
 
 const int wave_shift = WAVE_SHIFT;
 const int wave_len = WAVE_LEN;
 const int wave_max = WAVE_MAX;
 
-#ifdef __cplusplus
-};
-#endif
+static const uint8_t wavetable_frames = 8;
+
+extern const int16_t* const waves[];
+extern const Table<int16_t, (size_t)wavetable_frames << WAVE_SHIFT> wavetable;